@@ -40,5 +40,6 @@ void pce(const char* format, ...) ;
 void fflushc();
 
 void closePrinter();
+void splitFileName(const char *fullFileName, char *path, char *fileName, char *extension);
 
 #endif  // VARIABLEPRINTER_H
@@ -0,0 +1,82 @@
+/**
+ * @file tmo.h
+ * @brief Binary TM object format (.tmo), written by the compiler and loaded by the tm simulator.
+ *
+ * A .tmo file holds, in this order and with no padding:
+ *   - a TmoHeader;
+ *   - codeSize TmoInstruction records, record i being the instruction at iMem location i;
+ *   - symbolCount TmoSymbol records;
+ *   - stringSize bytes of NUL terminated symbol names, referenced by TmoSymbol::name;
+ *   - dataCount TmoData records, applied to dMem after the simulator's own reset.
+ * All fields are 32-bit little endian integers.
+ */
+
+#ifndef _TMO_H_
+#define _TMO_H_
+
+#include <stdint.h>
+
+/**
+ * @brief "TMO1" read as a little endian integer.
+ */
+#define TMO_MAGIC 0x314F4D54
+
+/**
+ * @brief Format version written to TmoHeader::version.
+ */
+#define TMO_VERSION 1
+
+/**
+ * @brief Opcode mnemonics indexed by TmoInstruction::op, in the order of the tm simulator's
+ * opcode table. The "????" entries separate the RR, RM and RA opcode classes and are never
+ * valid opcodes.
+ */
+#define TMO_OPCODES                                                                             \
+	{"HALT", "IN",  "OUT", "ADD", "SUB", "MUL", "DIV", "????", "LD",  "ST",                      \
+	 "????", "LDA", "LDC", "JLT", "JLE", "JGT", "JGE", "JEQ",  "JNE", "????"}
+
+/**
+ * @brief Number of entries in TMO_OPCODES.
+ */
+#define TMO_OPCODE_COUNT 20
+
+/**
+ * @brief File header.
+ */
+typedef struct {
+	uint32_t magic;       /**< TMO_MAGIC. */
+	uint32_t version;     /**< TMO_VERSION. */
+	int32_t  codeSize;    /**< Number of instruction records. */
+	int32_t  symbolCount; /**< Number of symbol records. */
+	int32_t  stringSize;  /**< Size in bytes of the symbol name table. */
+	int32_t  dataCount;   /**< Number of initial data memory records. */
+} TmoHeader;
+
+/**
+ * @brief Instruction record, field for field the simulator's in-memory instruction.
+ */
+typedef struct {
+	int32_t op;   /**< Index into TMO_OPCODES. */
+	int32_t arg1; /**< Register r. */
+	int32_t arg2; /**< Register s (RR) or displacement d (RM, RA). */
+	int32_t arg3; /**< Register t (RR) or base register s (RM, RA). */
+} TmoInstruction;
+
+/**
+ * @brief Symbol record: a function entry point.
+ */
+typedef struct {
+	int32_t loc;  /**< Instruction memory location of the entry point. */
+	int32_t line; /**< Source line of the declaration. */
+	int32_t name; /**< Offset of the name in the symbol name table. */
+} TmoSymbol;
+
+/**
+ * @brief Initial data memory record.
+ */
+typedef struct {
+	int32_t address; /**< Data memory address. */
+	int32_t value;   /**< Value stored there before execution starts. */
+} TmoData;
+
+#endif
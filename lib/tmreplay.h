@@ -0,0 +1,68 @@
+/**
+ * @file tmreplay.h
+ * @brief Binary TM replay log format, written by tm -R and read by tm -P.
+ *
+ * A replay log holds a TmrHeader followed by records up to the end of the file. Each record is
+ * a TmrRecord, and:
+ * - for TMR_INPUT, nothing more: value is the next IN value the execution consumed;
+ * - for TMR_CHECKPOINT, a TmrCheckpoint and then value pages, each an int32_t page number
+ *   followed by the words of that 1024-word page of data memory (fewer for a last, partial
+ *   page). The pages are those that changed since the previous checkpoint, so the data memory
+ *   at a checkpoint is that of tmReset with the pages of every checkpoint up to it applied;
+ * - for TMR_END, an int64_t instruction count: value is the STEPRESULT the execution ended with.
+ *
+ * The first record is the checkpoint of step 0. All fields are little endian integers.
+ */
+
+#ifndef _TMREPLAY_H_
+#define _TMREPLAY_H_
+
+#include <stdint.h>
+
+/**
+ * @brief "TMR1" read as a little endian integer.
+ */
+#define TMR_MAGIC 0x31524D54
+
+/**
+ * @brief Format version written to TmrHeader::version.
+ */
+#define TMR_VERSION 1
+
+/**
+ * @brief Kinds of TmrRecord.
+ */
+#define TMR_INPUT 1
+#define TMR_CHECKPOINT 2
+#define TMR_END 3
+
+/**
+ * @brief File header.
+ */
+typedef struct {
+	uint32_t magic;    /**< TMR_MAGIC. */
+	uint32_t version;  /**< TMR_VERSION. */
+	uint32_t program;  /**< Hash of the instruction memory the execution ran. */
+	int32_t  dSize;    /**< Data memory size in words. */
+	int64_t  interval; /**< Instructions between checkpoints. */
+} TmrHeader;
+
+/**
+ * @brief Start of every record.
+ */
+typedef struct {
+	int32_t kind;  /**< TMR_INPUT, TMR_CHECKPOINT or TMR_END. */
+	int32_t value; /**< Meaning depends on kind. */
+} TmrRecord;
+
+/**
+ * @brief Execution state at a checkpoint, apart from data memory.
+ */
+typedef struct {
+	int64_t steps;         /**< Instructions executed. */
+	int64_t inputs;        /**< IN values consumed. */
+	int64_t classCount[3]; /**< Instructions executed by OPCLASS. */
+	int32_t reg[8];        /**< Registers, the pc last. */
+} TmrCheckpoint;
+
+#endif
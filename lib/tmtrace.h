@@ -0,0 +1,43 @@
+/**
+ * @file tmtrace.h
+ * @brief Binary TM execution trace format, written by the tm simulator and read by tmtrace.
+ *
+ * A trace file holds a TmtHeader followed by one TmtRecord per executed instruction, in
+ * execution order, up to the end of the file. All fields are little endian integers.
+ */
+
+#ifndef _TMTRACE_H_
+#define _TMTRACE_H_
+
+#include <stdint.h>
+
+/**
+ * @brief "TMT1" read as a little endian integer.
+ */
+#define TMT_MAGIC 0x31544D54
+
+/**
+ * @brief Format version written to TmtHeader::version.
+ */
+#define TMT_VERSION 1
+
+/**
+ * @brief File header.
+ */
+typedef struct {
+	uint32_t magic;   /**< TMT_MAGIC. */
+	uint32_t version; /**< TMT_VERSION. */
+	int64_t  skipped; /**< Instructions traced before the first record but not kept. */
+} TmtHeader;
+
+/**
+ * @brief One executed instruction.
+ */
+typedef struct {
+	int32_t pc;      /**< Instruction memory location. */
+	int32_t op;      /**< Opcode, as TmoInstruction::op. */
+	int32_t value;   /**< Register r after the instruction, or before it if it faulted. */
+	int32_t address; /**< Data memory address of LD and ST, -1 for other opcodes. */
+} TmtRecord;
+
+#endif
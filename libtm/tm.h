@@ -0,0 +1,689 @@
+/**
+ * @file tm.h
+ * @brief Reentrant TM ("Tiny Machine") virtual machine library.
+ *
+ * A TMProgram holds everything derived from a loaded program: instruction memory, its
+ * pre-decoded form, the native code of the JIT engine and the symbols and data image of a .tmo
+ * object. It is not modified by execution, so any number of TMContexts, in one thread or
+ * several, can run the same program. A TMContext holds one execution of it: registers, data
+ * memory, the instruction counter and the I/O callbacks.
+ */
+
+#ifndef _TM_H_
+#define _TM_H_
+
+#include <stdio.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define IADDR_SIZE 1024 /* default instruction memory size, see tmProgramNew */
+#define DADDR_SIZE 1024 /* default data memory size, see tmContextNew */
+#define NO_REGS 8
+#define PC_REG 7
+
+#define WORDSIZE 20
+
+typedef enum {
+	opclRR, /* reg operands r,s,t */
+	opclRM, /* reg r, mem d+s */
+	opclRA  /* reg r, int d+s */
+} OPCLASS;
+
+typedef enum {
+	/* RR instructions */
+	opHALT,  /* RR     halt, operands are ignored */
+	opIN,    /* RR     read into reg(r); s and t are ignored */
+	opOUT,   /* RR     write from reg(r), s and t are ignored */
+	opADD,   /* RR     reg(r) = reg(s)+reg(t) */
+	opSUB,   /* RR     reg(r) = reg(s)-reg(t) */
+	opMUL,   /* RR     reg(r) = reg(s)*reg(t) */
+	opDIV,   /* RR     reg(r) = reg(s)/reg(t) */
+	opRRLim, /* limit of RR opcodes */
+
+	/* RM instructions */
+	opLD,    /* RM     reg(r) = mem(d+reg(s)) */
+	opST,    /* RM     mem(d+reg(s)) = reg(r) */
+	opRMLim, /* Limit of RM opcodes */
+
+	/* RA instructions */
+	opLDA,  /* RA     reg(r) = d+reg(s) */
+	opLDC,  /* RA     reg(r) = d ; reg(s) is ignored */
+	opJLT,  /* RA     if reg(r)<0 then reg(7) = d+reg(s) */
+	opJLE,  /* RA     if reg(r)<=0 then reg(7) = d+reg(s) */
+	opJGT,  /* RA     if reg(r)>0 then reg(7) = d+reg(s) */
+	opJGE,  /* RA     if reg(r)>=0 then reg(7) = d+reg(s) */
+	opJEQ,  /* RA     if reg(r)==0 then reg(7) = d+reg(s) */
+	opJNE,  /* RA     if reg(r)!=0 then reg(7) = d+reg(s) */
+	opRALim /* Limit of RA opcodes */
+} OPCODE;
+
+typedef enum {
+	srOKAY,
+	srHALT,
+	srIMEM_ERR,
+	srDMEM_ERR,
+	srZERODIVIDE,
+	srBUDGET,   /* instruction limit reached before HALT */
+	srNO_INPUT, /* IN executed with the input exhausted */
+	srTIMEOUT,  /* wall-clock limit reached before HALT */
+	srBREAK,    /* about to execute an instruction with a breakpoint */
+	srWATCH     /* stored into a watched data memory range */
+} STEPRESULT;
+
+typedef struct {
+	int iop;
+	int iarg1;
+	int iarg2;
+	int iarg3;
+} INSTRUCTION;
+
+typedef enum {
+	engSTEP,     /* one fetch/decode per instruction */
+	engTHREADED, /* pre-decoded instructions, direct-threaded dispatch */
+	engJIT       /* native x86-64 code, see tmTranslate */
+} ENGINE;
+
+/**
+ * @brief A loaded program, see tmProgramNew.
+ */
+typedef struct TMProgram TMProgram;
+
+/**
+ * @brief A saved execution state, see tmSnapshot.
+ */
+typedef struct TMSnapshot TMSnapshot;
+
+/**
+ * @brief A record of the instructions executed, see tmTraceNew.
+ */
+typedef struct TMTrace TMTrace;
+
+/**
+ * @brief Executions of one program in lockstep, see tmLanesNew.
+ */
+typedef struct TMLanes TMLanes;
+
+/**
+ * @brief Data memory accesses of executions and their cache behavior, see tmMemProfileNew.
+ */
+typedef struct TMMemProfile TMMemProfile;
+
+/**
+ * @brief Writes the replay log of an execution, see tmRecordNew.
+ */
+typedef struct TMRecorder TMRecorder;
+
+/**
+ * @brief Replays an execution from its log, see tmReplayOpen.
+ */
+typedef struct TMReplay TMReplay;
+
+/**
+ * @brief Supplies the value of an IN instruction.
+ *
+ * @return TRUE with *value set, or FALSE when the input is exhausted (srNO_INPUT).
+ */
+typedef int (*TMInput)(void* user, int* value);
+
+/**
+ * @brief Consumes the value of an OUT instruction.
+ */
+typedef void (*TMOutput)(void* user, int value);
+
+/**
+ * @brief Called when a HALT instruction executes, with its operands.
+ */
+typedef void (*TMHalt)(void* user, int r, int s, int t);
+
+/**
+ * @brief Execution counts of every instruction memory location, see tmProfileNew.
+ */
+typedef struct {
+	long* count; /**< Executions of each location. */
+	long* taken; /**< Taken jumps of each conditional jump location. */
+	int   size;  /**< Number of locations. */
+} TMProfile;
+
+/**
+ * @brief Cycles charged for each instruction and event by tmCycles, see tmReadCostModel.
+ */
+typedef struct {
+	long op[opRALim]; /**< Cycles of each executed instruction, by OPCODE. */
+	long taken;       /**< Extra cycles of a taken conditional jump. */
+	long jump;        /**< Extra cycles of any other instruction with the pc as destination. */
+} TMCostModel;
+
+/**
+ * @brief One execution of a program. Fields may be read, and the engine and callbacks set,
+ * between calls to tmStep and tmRun.
+ */
+typedef struct {
+	const TMProgram*  program;
+	int               reg[NO_REGS];
+	int*              dMem;   /**< Data memory, mapped lazily; tmReset may move it. */
+	int               dSize;  /**< Data memory size in words. */
+	long              steps;  /**< Instructions executed since the last tmReset. */
+	ENGINE            engine; /**< Engine used by tmRun, engSTEP by default. */
+	TMInput           input;  /**< Defaults to no input at all. */
+	TMOutput          output; /**< Defaults to "OUT instruction prints: <value>" on stdout. */
+	TMHalt            halt;   /**< Defaults to "HALT: r,s,t" on stdout. */
+	void*             user;   /**< Passed to the callbacks. */
+	/** When set, every instruction executed is counted in it and tmRun uses the step engine. */
+	TMProfile*        profile;
+	/** When set, every instruction executed is recorded in it and tmRun uses the step engine. */
+	TMTrace*          trace;
+	/** When set, every LD and ST is counted and simulated in it and tmRun uses the step engine. */
+	TMMemProfile*     memProfile;
+	long              classCount[3]; /**< The instructions of steps by OPCLASS. */
+	long              timeLimit;     /**< Milliseconds each tmRun may take, 0 for no limit. */
+	unsigned char*    pages;         /**< Write and watch flags of each 1024-word page of dMem. */
+	int*              watchTab;      /**< First and last address of each watched dMem range. */
+	int               watchCount;    /**< Number of watched ranges. */
+	int               watchHit;      /**< Address of the store that returned srWATCH. */
+	const TMSnapshot* base;          /**< Snapshot dMem equals except for dirty pages, or NULL. */
+} TMContext;
+
+/**
+ * @brief A vector of IN values, consumed in order by tmNextInput.
+ */
+typedef struct {
+	int* values;
+	int  count;
+	int  size; /**< Allocated length of values. */
+	int  pos;  /**< Index of the next value to be consumed. */
+} TMInputs;
+
+/**
+ * @brief A growable buffer of the text of OUT and HALT instructions, see tmAppendOutput.
+ */
+typedef struct {
+	char* text;
+	long  length;
+	long  size; /**< Allocated length of text. */
+	int   raw;  /**< Only the OUT values, one per line, instead of the lines tm prints. */
+} TMOutputs;
+
+/**
+ * @brief Scanner for the TM assembly syntax, shared by the loader and command interpreters.
+ */
+typedef struct {
+	const char* line;
+	int         lineLen;
+	int         inCol;
+	char        ch;
+	int         num;            /**< Value read by the last successful tmGetNum. */
+	char        word[WORDSIZE]; /**< Word read by the last successful tmGetWord. */
+} TMScanner;
+
+/**
+ * @brief Opcode mnemonics indexed by OPCODE.
+ */
+extern char* tmOpCodeTab[];
+
+/**
+ * @brief Description of each STEPRESULT.
+ */
+extern char* tmResultTab[];
+
+/**
+ * @brief Process exit status reporting each STEPRESULT, used by tm batch runs and by programs
+ * written by tmWriteC.
+ */
+extern int tmExitTab[];
+
+/**
+ * @brief Engine names indexed by ENGINE, as accepted on command lines.
+ */
+extern char* tmEngineTab[];
+
+/**
+ * @brief Returns the OPCLASS of an opcode.
+ */
+int tmOpClass(int op);
+
+/**
+ * @brief Creates an empty program: instruction memory holds HALT everywhere.
+ *
+ * @param iSize Instruction memory size in words, or 0 for IADDR_SIZE.
+ * @return The program, or NULL if out of memory.
+ */
+TMProgram* tmProgramNew(int iSize);
+
+/**
+ * @brief Frees a program. No context may still use it.
+ */
+void tmProgramFree(TMProgram* program);
+
+/**
+ * @brief Replaces the program with TM assembly text.
+ *
+ * @param text The assembly, one instruction or "*" comment per line.
+ * @param length Length of text in bytes.
+ * @return TRUE on success, FALSE with the reason available from tmError.
+ */
+int tmLoadText(TMProgram* program, const char* text, long length);
+
+/**
+ * @brief Replaces the program with a .tmo object image (see tmo.h), which is copied.
+ *
+ * @return TRUE on success, FALSE with the reason available from tmError.
+ */
+int tmLoadObject(TMProgram* program, const void* image, long size);
+
+/**
+ * @brief Replaces the program with a TM assembly or .tmo object file, told apart by the .tmo
+ * magic number.
+ *
+ * @return TRUE on success, FALSE with the reason available from tmError.
+ */
+int tmLoadFile(TMProgram* program, const char* fileName);
+
+/**
+ * @brief Describes why the last load failed.
+ */
+const char* tmError(const TMProgram* program);
+
+/**
+ * @brief Translates the program to native code for engJIT. Without it, or on hosts other than
+ * x86-64, engJIT runs the threaded engine.
+ *
+ * @return TRUE if native code is available.
+ */
+int tmTranslate(TMProgram* program);
+
+/**
+ * @brief Returns the instruction memory size of a program in words.
+ */
+int tmCodeSize(const TMProgram* program);
+
+/**
+ * @brief Returns the instruction at a location, which must be in 0..tmCodeSize-1.
+ */
+const INSTRUCTION* tmInstruction(const TMProgram* program, int loc);
+
+/**
+ * @brief Sets or clears a breakpoint. tmRun returns srBREAK before executing an instruction with
+ * a breakpoint, except the one it starts at, so calling it again continues. The engines are
+ * patched rather than checking every instruction: the threaded engine binds the location to a
+ * handler that stops and the JIT engine overwrites its native code with a call that leaves.
+ * Breakpoints belong to the program, so no context may be running it meanwhile.
+ *
+ * @return FALSE if loc is not in 0..tmCodeSize-1 or out of memory.
+ */
+int tmSetBreakpoint(TMProgram* program, int loc, int on);
+
+/**
+ * @brief Returns whether loc has a breakpoint.
+ */
+int tmBreakpointAt(const TMProgram* program, int loc);
+
+/**
+ * @brief Watches or stops watching data memory addresses first..last. A store into a watched
+ * range returns srWATCH after it is done, with the address in context->watchHit. Watched
+ * pages are flagged in context->pages, so stores elsewhere cost only the flag test they
+ * already make; stores into a watched page are executed by stepTM.
+ *
+ * @return FALSE if the range is not within dMem, was not watched or out of memory.
+ */
+int tmSetWatchpoint(TMContext* context, int first, int last, int on);
+
+/**
+ * @brief Returns the name of the function whose entry point is loc, or NULL. Entry points come
+ * from the symbol table of a .tmo object or from the "-> Init Function (name)" comments the C-
+ * code generator writes into .tm files.
+ */
+const char* tmSymbolAt(const TMProgram* program, int loc);
+
+/**
+ * @brief Returns the name of the function containing loc, or NULL if no entry point precedes it.
+ */
+const char* tmFunctionAt(const TMProgram* program, int loc);
+
+/**
+ * @brief Writes the instruction at loc, which must be in 0..tmCodeSize-1, as the debugger
+ * prints it: opcode and operands, without the location or a newline.
+ */
+void tmWriteInstruction(const TMProgram* program, int loc, FILE* f);
+
+/**
+ * @brief Writes the program as a standalone C program that reads IN values from stdin and
+ * reports its result like a tm batch run.
+ *
+ * @param sourceName Name of the program, recorded in a comment.
+ * @param dSize Data memory size of the generated program in words, or 0 for DADDR_SIZE.
+ * @return TRUE on success.
+ */
+int tmWriteC(const TMProgram* program, FILE* f, const char* sourceName, int dSize);
+
+/**
+ * @brief Creates a context for a program, reset and with the default engine and callbacks.
+ *
+ * @param dSize Data memory size in words, or 0 for DADDR_SIZE. Memory is reserved, not
+ * committed, so a large size costs nothing until the program touches it.
+ * @return The context, or NULL if out of memory.
+ */
+TMContext* tmContextNew(const TMProgram* program, int dSize);
+
+/**
+ * @brief Frees a context.
+ */
+void tmContextFree(TMContext* context);
+
+/**
+ * @brief Resets registers, data memory and the instruction counter for a new execution. Words
+ * of a .tmo data image beyond the data memory size are ignored.
+ */
+void tmReset(TMContext* context);
+
+/**
+ * @brief Executes one instruction with the step engine.
+ */
+STEPRESULT tmStep(TMContext* context);
+
+/**
+ * @brief Executes instructions with the context's engine until one does not return srOKAY.
+ *
+ * @param budget Maximum number of instructions to execute, or 0 for no limit. When it is used
+ * up the result is srBUDGET, after exactly budget instructions with every engine.
+ * context->timeLimit is checked between slices of instructions counted against the same
+ * budget, so the engines pay nothing for it; when it runs out the result is srTIMEOUT.
+ */
+STEPRESULT tmRun(TMContext* context, long budget);
+
+/**
+ * @brief Creates count executions of a program that run in lockstep, with registers and data
+ * memory laid out lane by lane so that an instruction runs on every lane at once.
+ *
+ * @param dSize Data memory size of every lane in words, or 0 for DADDR_SIZE.
+ * @return The lanes, or NULL if out of memory.
+ */
+TMLanes* tmLanesNew(const TMProgram* program, int count, int dSize);
+
+/**
+ * @brief Frees lanes and the contexts of tmLane.
+ */
+void tmLanesFree(TMLanes* lanes);
+
+/**
+ * @brief Returns the context of a lane, 0..count-1. Its callbacks, user and timeLimit are used
+ * by tmLanesRun; the rest is overwritten with the lane's final state.
+ */
+TMContext* tmLane(TMLanes* lanes, int lane);
+
+/**
+ * @brief Runs every lane from the start of the program until it stops, with the results,
+ * instruction counts and final states tmReset and tmRun would give its context. Lanes that
+ * jump apart are masked until they meet again. Engines, breakpoints, watchpoints, profiles and
+ * traces of the contexts are not used.
+ *
+ * @param budget Maximum number of instructions of each lane, or 0 for no limit.
+ * @param results The result of every lane.
+ */
+void tmLanesRun(TMLanes* lanes, long budget, STEPRESULT* results);
+
+/**
+ * @brief Saves the registers, instruction counter and data memory of a context. Only the pages
+ * written since tmReset are copied.
+ *
+ * @return The snapshot, or NULL if out of memory.
+ */
+TMSnapshot* tmSnapshot(TMContext* context);
+
+/**
+ * @brief Returns a context to a saved state. When the snapshot is the one last taken or
+ * restored in this context, only the data memory pages written since then are copied back, so
+ * a run costs only the memory it changes. Pages of dMem written other than by TM instructions
+ * must be flagged in context->pages.
+ *
+ * @return TRUE, or FALSE if the snapshot was taken from a data memory of another size.
+ */
+int tmRestore(TMContext* context, const TMSnapshot* snapshot);
+
+/**
+ * @brief Frees a snapshot.
+ */
+void tmSnapshotFree(TMSnapshot* snapshot);
+
+/**
+ * @brief Starts recording the execution of a context, which must have just been reset, to a
+ * replay log in the lib/tmreplay.h format: every IN value the context's input callback
+ * supplies, and a checkpoint of the registers and changed data memory pages every interval
+ * instructions. Until tmRecordEnd, the recorder stands in for the context's callbacks and
+ * user, which it calls, and the context must be run by tmRecordRun.
+ *
+ * @param interval Instructions between checkpoints, 0 for the default of 2^20.
+ * @return The recorder, or NULL if out of memory.
+ */
+TMRecorder* tmRecordNew(TMContext* context, FILE* file, long interval);
+
+/**
+ * @brief Runs the recorded context like tmRun, stopping at every checkpoint to write it.
+ */
+STEPRESULT tmRecordRun(TMRecorder* recorder, long budget);
+
+/**
+ * @brief Ends the log with the result of the execution, gives the context its callbacks back
+ * and frees the recorder. The file is flushed but not closed.
+ *
+ * @return TRUE if every write to the file succeeded.
+ */
+int tmRecordEnd(TMRecorder* recorder, STEPRESULT result);
+
+/**
+ * @brief Opens the replay log of an execution of the context's program, with the context's
+ * data memory size, and resets the context to its start. The context's IN values then come
+ * from the log; its output and halt callbacks are called as before.
+ *
+ * @return The replay, or NULL if the file is not such a log or out of memory.
+ */
+TMReplay* tmReplayOpen(TMContext* context, FILE* file);
+
+/**
+ * @brief Takes the context to the state the recorded execution had after step instructions:
+ * from the last checkpoint at or before step, unless the context is already between it and
+ * step, the context runs forward to step. OUT and HALT callbacks are called on the way.
+ *
+ * @param result Set to the result of that run, srOKAY if step was reached.
+ * @return TRUE, or FALSE if the log could not be read.
+ */
+int tmReplaySeek(TMReplay* replay, long step, STEPRESULT* result);
+
+/**
+ * @brief Returns the instructions the recorded execution ran, or -1 if its log was cut short.
+ */
+long tmReplaySteps(const TMReplay* replay);
+
+/**
+ * @brief Gives the context its callbacks back and frees the replay. The file is not closed.
+ */
+void tmReplayClose(TMReplay* replay);
+
+/**
+ * @brief Creates zeroed execution counts for a program, to be set as context->profile.
+ *
+ * @return The profile, or NULL if out of memory.
+ */
+TMProfile* tmProfileNew(const TMProgram* program);
+
+/**
+ * @brief Frees a profile. No context may still use it.
+ */
+void tmProfileFree(TMProfile* profile);
+
+/**
+ * @brief Writes a report of a profile: instructions per function, the hottest basic blocks and
+ * loops, every conditional jump with its taken and not taken counts and the calls made from
+ * each call site. With a cost model, the total and each function's estimated cycles as well.
+ *
+ * @param model The cost model, or NULL.
+ * @return TRUE on success.
+ */
+int tmWriteProfile(const TMProgram* program, const TMProfile* profile, const TMCostModel* model,
+                   FILE* f);
+
+/**
+ * @brief Sets a cost model to one cycle per instruction and no event costs, which makes the
+ * cycles of an execution its instruction count.
+ */
+void tmCostModelInit(TMCostModel* model);
+
+/**
+ * @brief Reads a cost model, changing the costs the file names. Each line holds an opcode
+ * mnemonic, "taken" or "jump" and a number of cycles; blank lines and lines starting with '*'
+ * are skipped.
+ *
+ * @param badLine Set to the number of the first malformed line, or 0.
+ * @return TRUE on success.
+ */
+int tmReadCostModel(TMCostModel* model, FILE* f, int* badLine);
+
+/**
+ * @brief Returns the estimated cycles of the executions of loc counted in a profile.
+ */
+long tmLocationCycles(const TMProgram* program, const TMProfile* profile,
+                      const TMCostModel* model, int loc);
+
+/**
+ * @brief Returns the estimated cycles of all the instructions counted in a profile.
+ */
+long tmCycles(const TMProgram* program, const TMProfile* profile, const TMCostModel* model);
+
+/**
+ * @brief Creates zeroed data memory access counts for a program, to be set as
+ * context->memProfile, and an empty set-associative cache with least recently used
+ * replacement through which every access goes.
+ *
+ * @param dSize     Data memory size in words of the contexts it is used with, 0 for the default.
+ * @param sets      Number of sets of the cache.
+ * @param ways      Lines in each set.
+ * @param lineWords Words in each line.
+ * @return The profile, or NULL if a cache parameter is not positive or out of memory.
+ */
+TMMemProfile* tmMemProfileNew(const TMProgram* program, int dSize, int sets, int ways,
+                              int lineWords);
+
+/**
+ * @brief Frees a memory profile. No context may still use it.
+ */
+void tmMemProfileFree(TMMemProfile* profile);
+
+/**
+ * @brief Writes a report of a memory profile: cache hits and misses per function and per array,
+ * and the reads, writes and misses of every data memory address accessed. Arrays are told by
+ * the code generator's indexing idiom and named by their base address.
+ *
+ * @return TRUE on success.
+ */
+int tmWriteMemProfile(const TMProgram* program, const TMMemProfile* profile, FILE* f);
+
+/**
+ * @brief Creates an execution trace, to be set as context->trace, that holds the last size
+ * instructions executed. With a file, every instruction also reaches it in the lib/tmtrace.h
+ * format, written a buffer at a time; tmTraceFlush writes the rest.
+ *
+ * @return The trace, or NULL if out of memory or the file header cannot be written.
+ */
+TMTrace* tmTraceNew(int size, FILE* file);
+
+/**
+ * @brief Writes the records of a trace not yet written to its file.
+ *
+ * @return TRUE, or FALSE if a write to the file failed since tmTraceNew.
+ */
+int tmTraceFlush(TMTrace* trace);
+
+/**
+ * @brief Writes the instructions a trace holds, oldest first, as a complete trace file.
+ *
+ * @return TRUE on success.
+ */
+int tmTraceWrite(const TMTrace* trace, FILE* file);
+
+/**
+ * @brief Frees a trace without flushing it. No context may still use it.
+ */
+void tmTraceFree(TMTrace* trace);
+
+/**
+ * @brief Appends the integers in text, separated by whitespace or commas, to an input vector.
+ *
+ * @return NULL on success, otherwise where the first illegal value starts.
+ */
+const char* tmAddInputs(TMInputs* inputs, const char* text);
+
+/**
+ * @brief Appends all integers in a stream to an input vector.
+ *
+ * @return TRUE on success, FALSE on a read error or an illegal value.
+ */
+int tmReadInputs(TMInputs* inputs, FILE* f);
+
+/**
+ * @brief TMInput that consumes an input vector, passed as user.
+ */
+int tmNextInput(void* inputs, int* value);
+
+/**
+ * @brief Frees the values of an input vector and empties it.
+ */
+void tmFreeInputs(TMInputs* inputs);
+
+/**
+ * @brief Appends the line of an OUT instruction to an output buffer: "OUT instruction prints:
+ * <value>", or the value alone if the buffer is raw.
+ *
+ * @return TRUE, or FALSE if out of memory.
+ */
+int tmAppendOutput(TMOutputs* outputs, int value);
+
+/**
+ * @brief Appends the line of a HALT instruction, "HALT: r,s,t", to an output buffer that is not
+ * raw.
+ *
+ * @return TRUE, or FALSE if out of memory.
+ */
+int tmAppendHalt(TMOutputs* outputs, int r, int s, int t);
+
+/**
+ * @brief Writes the text of an output buffer to a stream and empties the buffer.
+ *
+ * @return TRUE on success.
+ */
+int tmWriteOutputs(TMOutputs* outputs, FILE* f);
+
+/**
+ * @brief Frees the text of an output buffer and empties it; raw is kept.
+ */
+void tmFreeOutputs(TMOutputs* outputs);
+
+/**
+ * @brief Starts scanning a line of text; a trailing newline is ignored.
+ */
+void tmScanLine(TMScanner* scanner, const char* line, int length);
+
+/**
+ * @brief Reads a number, possibly a sum like "3+-1", into scanner->num.
+ */
+int tmGetNum(TMScanner* scanner);
+
+/**
+ * @brief Reads an alphanumeric word into scanner->word.
+ */
+int tmGetWord(TMScanner* scanner);
+
+/**
+ * @brief Skips the character c if it is the next non-blank one.
+ */
+int tmSkipCh(TMScanner* scanner, char c);
+
+/**
+ * @brief Tells whether only blanks are left.
+ */
+int tmAtEOL(TMScanner* scanner);
+
+#endif
@@ -0,0 +1,163 @@
+/****************************************************/
+/* File: tmc.c                                      */
+/* Ahead-of-time translation of TM programs to C    */
+/****************************************************/
+
+#include "tmint.h"
+
+#define OUTBUF_SIZE 65536 /* stdio buffer of the generated program */
+
+/********************************************/
+/* Ahead-of-time translation to C: every iMem location becomes a labeled statement, constant
+ * jumps become gotos and computed jumps go through a dense switch over all locations. The
+ * program reads IN values from stdin and reports its result like a batch run.
+ */
+
+/* C expression for the value of register r as an operand of the instruction at loc */
+static char* cReg(char* cOperand, int r, int loc) {
+	if (r == PC_REG)
+		sprintf(cOperand, "%d", loc + 1);
+	else
+		sprintf(cOperand, "reg[%d]", r);
+	return cOperand;
+} /* cReg */
+
+/* index of a result in the tables of the generated program */
+static int cResult(STEPRESULT result) {
+	return result - srHALT;
+} /* cResult */
+
+/* C statement transferring control to the constant target pc */
+static void cGoto(FILE* f, const TMProgram* program, int target) {
+	if ((target >= 0) && (target < program->iSize))
+		fprintf(f, "goto L%d;", target);
+	else
+		fprintf(f, "{ pc = %d; goto dispatch; }", target);
+} /* cGoto */
+
+/********************************************/
+int tmWriteC(const TMProgram* program, FILE* f, const char* sourceName, int dSize) {
+	static char* cRelTab[] = {"<", "<=", ">", ">=", "==", "!="};
+	static char* cOpTab[]  = {"+", "-", "*", "/"};
+	const INSTRUCTION* in;
+	char               op[32];
+	int                loc, r, s, t, d;
+
+	fprintf(f, "/* Generated by tm -C from %s */\n", sourceName);
+	fprintf(f, "#include <ctype.h>\n#include <stdio.h>\n\n");
+	fprintf(f, "#define IADDR_SIZE %d\n#define DADDR_SIZE %d\n\n", program->iSize,
+	        (dSize > 0) ? dSize : DADDR_SIZE);
+	fprintf(f, "static int reg[%d];\nstatic int dMem[DADDR_SIZE];\n\n", NO_REGS);
+	/* the generated tables start at srHALT, see cResult */
+	fprintf(f, "static const char* resultTab[] = {");
+	for (r = srHALT; r <= srNO_INPUT; r++) fprintf(f, "\"%s\", ", tmResultTab[r]);
+	fprintf(f, "};\nstatic const int exitTab[] = {");
+	for (r = srHALT; r <= srNO_INPUT; r++) fprintf(f, "%d, ", tmExitTab[r]);
+	fprintf(f, "};\n\n");
+	fprintf(f, "static int readIn(int* v) {\n"
+	           "\tint c;\n"
+	           "\twhile (((c = getchar()) == ',') || isspace(c));\n"
+	           "\tif (c == EOF) return 0;\n"
+	           "\tungetc(c, stdin);\n"
+	           "\treturn scanf(\"%%d\", v) == 1;\n"
+	           "}\n\n");
+	fprintf(f, "int main(void) {\n"
+	           "\tstatic char outBuf[%d];\n"
+	           "\tlong steps = 0;\n"
+	           "\tint  pc = 0, m, result;\n\n"
+	           "\tsetvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));\n"
+	           "\tdMem[0] = DADDR_SIZE - 1;\n"
+	           "\tgoto L0;\n\n",
+	        OUTBUF_SIZE);
+	for (loc = 0; loc < program->iSize; loc++) {
+		in = &program->iMem[loc];
+		r  = in->iarg1;
+		s  = in->iarg2;
+		t  = in->iarg3;
+		d  = in->iarg2;
+		fprintf(f, "L%d:\t/* %4s %d,", loc, tmOpCodeTab[in->iop], r);
+		if (tmOpClass(in->iop) == opclRR)
+			fprintf(f, "%d,%d */\n\tsteps++; ", s, t);
+		else {
+			fprintf(f, "%d(%d) */\n\tsteps++; ", d, t);
+			s = t;
+		}
+		switch (in->iop) {
+			case opHALT:
+				fprintf(f, "printf(\"HALT: %%1d,%%1d,%%1d\\n\", %d, %d, %d); ", r, s, t);
+				fprintf(f, "pc = %d; result = %d; goto done;\n", loc + 1, cResult(srHALT));
+				break;
+			case opIN:
+				if (r == PC_REG) {
+					fprintf(f, "if (!readIn(&pc)) { pc = %d; result = %d; goto done; } ", loc + 1,
+					        cResult(srNO_INPUT));
+					fprintf(f, "goto dispatch;\n");
+				} else
+					fprintf(f, "if (!readIn(&reg[%d])) { pc = %d; result = %d; goto done; }\n", r,
+					        loc + 1, cResult(srNO_INPUT));
+				break;
+			case opOUT:
+				fprintf(f, "printf(\"OUT instruction prints: %%d\\n\", %s);\n", cReg(op, r, loc));
+				break;
+			case opDIV:
+				fprintf(f, "if (%s == 0) { pc = %d; result = %d; goto done; } ", cReg(op, t, loc),
+				        loc + 1, cResult(srZERODIVIDE));
+				/* fall through */
+			case opADD:
+			case opSUB:
+			case opMUL:
+				fprintf(f, "%s = ", (r == PC_REG) ? "pc" : cReg(op, r, loc));
+				fprintf(f, "%s %s ", cReg(op, s, loc), cOpTab[in->iop - opADD]);
+				fprintf(f, "%s;", cReg(op, t, loc));
+				fprintf(f, (r == PC_REG) ? " goto dispatch;\n" : "\n");
+				break;
+			case opLD:
+			case opST:
+				fprintf(f, "m = %d + %s; ", d, cReg(op, s, loc));
+				fprintf(f, "if ((unsigned) m >= DADDR_SIZE) { pc = %d; result = %d; goto done; } ",
+				        loc + 1, cResult(srDMEM_ERR));
+				if (in->iop == opST)
+					fprintf(f, "dMem[m] = %s;\n", cReg(op, r, loc));
+				else if (r == PC_REG)
+					fprintf(f, "pc = dMem[m]; goto dispatch;\n");
+				else
+					fprintf(f, "reg[%d] = dMem[m];\n", r);
+				break;
+			case opLDA:
+			case opLDC:
+				if (in->iop == opLDC) s = -1;
+				if (r != PC_REG) {
+					fprintf(f, "reg[%d] = %d", r, d);
+					if (s >= 0) fprintf(f, " + %s", cReg(op, s, loc));
+					fprintf(f, ";\n");
+				} else if ((s < 0) || (s == PC_REG)) {
+					cGoto(f, program, (s < 0) ? d : d + loc + 1);
+					fprintf(f, "\n");
+				} else
+					fprintf(f, "pc = %d + %s; goto dispatch;\n", d, cReg(op, s, loc));
+				break;
+			default:
+				fprintf(f, "if (%s %s 0) ", cReg(op, r, loc), cRelTab[in->iop - opJLT]);
+				if (s == PC_REG)
+					cGoto(f, program, d + loc + 1);
+				else
+					fprintf(f, "{ pc = %d + %s; goto dispatch; }", d, cReg(op, s, loc));
+				fprintf(f, "\n");
+				break;
+		}
+	}
+	fprintf(f, "\tpc = IADDR_SIZE;\n\n");
+	fprintf(f, "dispatch:\n"
+	           "\tswitch (pc) {\n");
+	for (loc = 0; loc < program->iSize; loc++) fprintf(f, "\t\tcase %d: goto L%d;\n", loc, loc);
+	fprintf(f, "\t}\n"
+	           "\tsteps++;\n"
+	           "\tresult = %d;\n\n"
+	           "done:\n"
+	           "\tfflush(stdout);\n"
+	           "\tfprintf(stderr, \"%%s after %%ld instructions\\n\", resultTab[result], steps);\n"
+	           "\treturn exitTab[result];\n"
+	           "}\n",
+	        cResult(srIMEM_ERR));
+	return !ferror(f);
+} /* tmWriteC */
@@ -0,0 +1,79 @@
+/****************************************************/
+/* File: tmcost.c                                   */
+/* Cycle estimates of TM executions                 */
+/****************************************************/
+
+#include <string.h>
+
+#include "tmint.h"
+
+#define COSTLINE_SIZE 121
+
+/********************************************/
+void tmCostModelInit(TMCostModel* model) {
+	int op;
+	for (op = 0; op < opRALim; op++) model->op[op] = 1;
+	model->op[opRRLim] = 0;
+	model->op[opRMLim] = 0;
+	model->taken       = 0;
+	model->jump        = 0;
+} /* tmCostModelInit */
+
+/********************************************/
+int tmReadCostModel(TMCostModel* model, FILE* f, int* badLine) {
+	TMScanner sc;
+	char      line[COSTLINE_SIZE];
+	long*     cost;
+	int       lineNo = 0;
+	int       op;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineNo++;
+		tmScanLine(&sc, line, strlen(line));
+		if (tmAtEOL(&sc) || tmSkipCh(&sc, '*')) continue;
+		cost = NULL;
+		if (tmGetWord(&sc)) {
+			if (strcmp(sc.word, "taken") == 0)
+				cost = &model->taken;
+			else if (strcmp(sc.word, "jump") == 0)
+				cost = &model->jump;
+			else
+				for (op = 0; op < opRALim; op++) /* a word never matches the limits' "????" */
+					if (strcmp(sc.word, tmOpCodeTab[op]) == 0) cost = &model->op[op];
+		}
+		if ((cost == NULL) || !tmGetNum(&sc) || (sc.num < 0) || !tmAtEOL(&sc)) {
+			*badLine = lineNo;
+			return FALSE;
+		}
+		*cost = sc.num;
+	}
+	*badLine = 0;
+	return !ferror(f);
+} /* tmReadCostModel */
+
+/********************************************/
+/* whether the instruction writes the pc without being a conditional jump */
+static int isJump(const INSTRUCTION* in) {
+	return (in->iarg1 == PC_REG) && (in->iop != opHALT) && (in->iop != opOUT) &&
+	       (in->iop != opST) && (in->iop < opJLT);
+} /* isJump */
+
+/********************************************/
+long tmLocationCycles(const TMProgram* program, const TMProfile* profile,
+                      const TMCostModel* model, int loc) {
+	const INSTRUCTION* in;
+	long               cycles;
+	if ((loc < 0) || (loc >= profile->size) || (loc >= program->iSize)) return 0;
+	in     = &program->iMem[loc];
+	cycles = profile->count[loc] * (model->op[in->iop] + (isJump(in) ? model->jump : 0));
+	if (in->iop >= opJLT) cycles += profile->taken[loc] * model->taken;
+	return cycles;
+} /* tmLocationCycles */
+
+/********************************************/
+long tmCycles(const TMProgram* program, const TMProfile* profile, const TMCostModel* model) {
+	long cycles = 0;
+	int  loc;
+	for (loc = 0; loc < profile->size; loc++)
+		cycles += tmLocationCycles(program, profile, model, loc);
+	return cycles;
+} /* tmCycles */
@@ -0,0 +1,71 @@
+/****************************************************/
+/* File: tmdebug.c                                  */
+/* Breakpoints and watchpoints of TM programs       */
+/****************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmint.h"
+
+/********************************************/
+int tmSetBreakpoint(TMProgram* program, int loc, int on) {
+	if ((loc < 0) || (loc >= program->iSize)) return FALSE;
+	if (program->breakpoints == NULL) {
+		if (!on) return TRUE;
+		program->breakpoints = calloc(program->iSize, 1);
+		if (program->breakpoints == NULL) return FALSE;
+	}
+	if (!program->breakpoints[loc] == !on) return TRUE;
+	if (!patchJIT(program, loc, on)) return FALSE;
+	program->breakpoints[loc] = (unsigned char) (on != 0);
+	program->breakCount += on ? 1 : -1;
+	runThreaded(NULL, 0, program); /* rebind the locations around loc */
+	return TRUE;
+} /* tmSetBreakpoint */
+
+/********************************************/
+int tmBreakpointAt(const TMProgram* program, int loc) {
+	return (program->breakCount > 0) && (loc >= 0) && (loc < program->iSize) &&
+	       program->breakpoints[loc];
+} /* tmBreakpointAt */
+
+/********************************************/
+int tmSetWatchpoint(TMContext* context, int first, int last, int on) {
+	int* watchTab;
+	int  i, p;
+	if ((first < 0) || (first > last) || (last >= context->dSize)) return FALSE;
+	for (i = 0; i < context->watchCount; i++)
+		if ((context->watchTab[2 * i] == first) && (context->watchTab[2 * i + 1] == last)) break;
+	if (on) {
+		if (i < context->watchCount) return TRUE;
+		watchTab = realloc(context->watchTab, (i + 1) * 2 * sizeof(int));
+		if (watchTab == NULL) return FALSE;
+		context->watchTab            = watchTab;
+		context->watchTab[2 * i]     = first;
+		context->watchTab[2 * i + 1] = last;
+		context->watchCount++;
+	} else {
+		if (i == context->watchCount) return FALSE;
+		context->watchCount--;
+		memmove(&context->watchTab[2 * i], &context->watchTab[2 * i + 2],
+		        (context->watchCount - i) * 2 * sizeof(int));
+	}
+	/* flag the pages of the ranges that remain */
+	for (p = 0; p < DPAGES(context->dSize); p++) context->pages[p] &= ~DPAGE_WATCH;
+	for (i = 0; i < context->watchCount; i++)
+		for (p = context->watchTab[2 * i] >> DPAGE_SHIFT;
+		     p <= context->watchTab[2 * i + 1] >> DPAGE_SHIFT; p++)
+			context->pages[p] |= DPAGE_WATCH;
+	return TRUE;
+} /* tmSetWatchpoint */
+
+/********************************************/
+/* whether a store into address, in a page flagged DPAGE_WATCH, hits a watched range */
+int watchedAddress(const TMContext* context, int address) {
+	int i;
+	for (i = 0; i < context->watchCount; i++)
+		if ((address >= context->watchTab[2 * i]) && (address <= context->watchTab[2 * i + 1]))
+			return TRUE;
+	return FALSE;
+} /* watchedAddress */
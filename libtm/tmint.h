@@ -0,0 +1,181 @@
+/****************************************************/
+/* File: tmint.h                                    */
+/* Internal declarations shared by the libtm        */
+/* translation units                                */
+/****************************************************/
+
+#ifndef _TMINT_H_
+#define _TMINT_H_
+
+#include "tm.h"
+#include "tmtrace.h"
+
+#if defined(__x86_64__)
+#define HAVE_JIT TRUE
+#else
+#define HAVE_JIT FALSE
+#endif
+
+/* operation of a pre-decoded instruction, bound to a handler address at load time */
+typedef enum {
+	hSTEP, /* anything unusual (I/O, HALT, pc as operand): executed by stepTM */
+	hADD,
+	hSUB,
+	hMUL,
+	hDIV,
+	hLD,
+	hLDPC, /* LD 7,d(s): jump through memory */
+	hST,
+	hLDA,
+	hLDC,
+	hJMP, /* LDA/LDC with pc as destination */
+	hJLT,
+	hJLE,
+	hJGT,
+	hJGE,
+	hJEQ,
+	hJNE,
+	/* superinstructions for the idioms of the C- code generator, see fuseInstructions */
+	hRELLT, /* SUB a,b,c; Jxx a,2(7); LDC a,0; LDA 7,1(7); LDC a,1 */
+	hRELLE,
+	hRELGT,
+	hRELGE,
+	hRELEQ,
+	hRELNE,
+	hLDADD, /* LD 1,k(2) followed by the operator */
+	hLDSUB,
+	hLDMUL,
+	hLDDIV,
+	hSTLD,  /* ST 0,k(2) followed by a load of the next operand */
+	hSTLDC,
+	hIDXLD, /* LDC 4,1; ADD 3,3,4; SUB 0,0,3; LD 0,0(0) */
+	hIDXST, /* LDC 4,1; ADD 3,3,4; SUB 1,1,3; ST 0,0(1) */
+	/* handlers of jumps to a constant target in iMem, never kinds, see verifyInstructions */
+	hJMPK,
+	hJLTK,
+	hJLEK,
+	hJGTK,
+	hJGEK,
+	hJEQK,
+	hJNEK,
+	hBREAK, /* handler bound to the location of a breakpoint, never a kind */
+	hLim
+} HANDLER;
+
+typedef struct {
+	void* handler;  /* address of the implementation in runThreaded */
+	int   kind;     /* HANDLER of this instruction alone */
+	int   fused;    /* HANDLER of the superinstruction starting here, or hSTEP */
+	int   r, s, t;  /* register operands; ZERO_REG stands for a pc-relative base */
+	int   d;        /* displacement, with pc+1 folded in when the base is the pc */
+	int   verified; /* a jump to a constant location in iMem, taken without a bounds check */
+} DECODED;
+
+#define ZERO_REG NO_REGS /* extra always-zero register used by the decoded form */
+
+/* flags of a dMem page in context->pages; every store sets DPAGE_STORE, snapshots and restores
+ * clear DPAGE_DIRTY and tmReset clears both. DPAGE_WATCH is kept until tmSetWatchpoint changes
+ * it; the engines leave stores into such a page to stepTM.
+ */
+#define DPAGE_SHIFT 10  /* log2 of the page size in words */
+#define DPAGE_DIRTY 1   /* written since the last tmSnapshot or tmRestore */
+#define DPAGE_WRITTEN 2 /* written since tmReset */
+#define DPAGE_STORE (DPAGE_DIRTY | DPAGE_WRITTEN)
+#define DPAGE_WATCH 4   /* holds a watched address */
+#define DPAGES(dSize) (((dSize) + (1 << DPAGE_SHIFT) - 1) >> DPAGE_SHIFT)
+
+/* function entry point, from the symbol table of a .tmo object file or the code generator's
+ * "-> Init Function (name)" comments, or call site from its "-> Function call (name)" comments
+ */
+typedef struct {
+	int   loc;
+	int   line;
+	char* name;
+} SYMBOL;
+
+/* initial data memory word of a .tmo object file */
+typedef struct {
+	int address;
+	int value;
+} DATAWORD;
+
+struct TMProgram {
+	int            iSize; /* instruction memory size */
+	INSTRUCTION*   iMem;
+	DECODED*       dCode; /* plus an entry at iSize that faults, reached by falling off the end */
+	SYMBOL*        symTab; /* function entry points */
+	int            symCount;
+	SYMBOL*        callTab; /* first location of each call sequence, and the callee */
+	int            callCount;
+	DATAWORD*      dataImage; /* initial dMem contents of a .tmo program */
+	int            dataCount;
+	unsigned char* breakpoints; /* flag per location, NULL until a breakpoint is set */
+	int            breakCount;
+	unsigned char* jitCode;  /* NULL until tmTranslate succeeds */
+	void*          jitStart; /* int jitStart(JITSTATE*): enter at reg[PC_REG], return a STEPRESULT */
+	void**         jitEntry; /* native address of every location, plus the end */
+	unsigned char* jitSaved; /* native code overwritten by each breakpoint */
+	int            jitStretch; /* most instructions native code runs between two limit checks */
+	char           error[128];
+};
+
+struct TMSnapshot {
+	const TMContext* owner;
+	int              reg[NO_REGS];
+	long             steps;
+	long             classCount[3];
+	int              dSize;
+	int*             slot; /* of every page: index of its copy in data, or -1 for a zero page */
+	int*             data; /* copies of the pages written before the snapshot */
+};
+
+struct TMTrace {
+	TmtRecord* ring;    /* the last size records, record n at ring[n % size] */
+	int        size;
+	long       count;   /* records added */
+	long       written; /* records written to file */
+	FILE*      file;    /* destination of every record, or NULL */
+	int        error;   /* a write to file failed */
+};
+
+struct TMMemProfile {
+	int   dSize;
+	int   iSize;
+	long* reads;       /* of every dMem address */
+	long* writes;
+	long* misses;
+	long* locHits;     /* of the LD and ST at every iMem location */
+	long* locMisses;
+	long* arrayHits;   /* of the elements of the array with each base address */
+	long* arrayMisses;
+	int*  arrayLow;    /* lowest element address accessed, valid for the arrays accessed */
+	int   sets, ways, lineWords;
+	int*  lines;       /* line in each way of each set, most recently used first, or -1 */
+};
+
+/* tmload.c */
+void decodeInstructions(TMProgram* program);
+int  fusedLength(int fused);
+int  functionIndex(const TMProgram* program, int loc);
+
+/* tmrun.c */
+int*       mapMemory(size_t words);
+long       clockMillis(void);
+STEPRESULT stepTM(TMContext* context);
+STEPRESULT runThreaded(TMContext* context, long stop, TMProgram* bind);
+
+/* tmsnap.c */
+int pageWords(int dSize, int p);
+
+/* tmmem.c */
+void memAccess(TMMemProfile* profile, const TMContext* context, int pc, int address);
+
+/* tmdebug.c */
+int watchedAddress(const TMContext* context, int address);
+
+/* tmjit.c */
+STEPRESULT runJIT(TMContext* context, long stop);
+void       freeJIT(TMProgram* program);
+int        patchJIT(TMProgram* program, int loc, int on);
+
+#endif
@@ -0,0 +1,137 @@
+/****************************************************/
+/* File: tmio.c                                     */
+/* Input vectors for IN instructions and output     */
+/* buffers for OUT instructions                     */
+/****************************************************/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmint.h"
+
+/********************************************/
+const char* tmAddInputs(TMInputs* inputs, const char* text) {
+	char* end;
+	long  value;
+	int*  values;
+	while (*text != '\0') {
+		if (isspace(*text) || (*text == ',')) {
+			text++;
+			continue;
+		}
+		value = strtol(text, &end, 10);
+		if (end == text) return text;
+		if (inputs->count >= inputs->size) {
+			values = realloc(inputs->values, (inputs->size ? 2 * inputs->size : 256) * sizeof(int));
+			if (values == NULL) return text;
+			inputs->values = values;
+			inputs->size   = inputs->size ? 2 * inputs->size : 256;
+		}
+		inputs->values[inputs->count++] = (int) value;
+		text                            = end;
+	}
+	return NULL;
+} /* tmAddInputs */
+
+/********************************************/
+int tmReadInputs(TMInputs* inputs, FILE* f) {
+	char* text = NULL;
+	char* grown;
+	long  len  = 0;
+	long  size = 0;
+	int   ok;
+	do {
+		if (size - len < 4096) {
+			size  = size ? 2 * size : 65536;
+			grown = realloc(text, size);
+			if (grown == NULL) {
+				free(text);
+				return FALSE;
+			}
+			text = grown;
+		}
+		len += fread(text + len, 1, size - len - 1, f);
+	} while (!feof(f) && !ferror(f));
+	text[len] = '\0';
+	ok        = !ferror(f) && (tmAddInputs(inputs, text) == NULL);
+	free(text);
+	return ok;
+} /* tmReadInputs */
+
+/********************************************/
+int tmNextInput(void* user, int* value) {
+	TMInputs* inputs = user;
+	if (inputs->pos >= inputs->count) return FALSE;
+	*value = inputs->values[inputs->pos++];
+	return TRUE;
+} /* tmNextInput */
+
+/********************************************/
+void tmFreeInputs(TMInputs* inputs) {
+	free(inputs->values);
+	memset(inputs, 0, sizeof(TMInputs));
+} /* tmFreeInputs */
+
+/* room for extra characters at the end of the text */
+static int reserve(TMOutputs* outputs, long extra) {
+	char* text;
+	long  size;
+	if (outputs->length + extra <= outputs->size) return TRUE;
+	size = outputs->size ? 2 * outputs->size : 65536;
+	while (size < outputs->length + extra) size *= 2;
+	text = realloc(outputs->text, size);
+	if (text == NULL) return FALSE;
+	outputs->text = text;
+	outputs->size = size;
+	return TRUE;
+} /* reserve */
+
+/* a decimal number, without going through stdio */
+static void appendNumber(TMOutputs* outputs, int value) {
+	char          digits[12];
+	unsigned long n = (value < 0) ? -(unsigned long) value : (unsigned long) value;
+	int           i = 0;
+	do {
+		digits[i++] = (char) ('0' + n % 10);
+		n /= 10;
+	} while (n > 0);
+	if (value < 0) outputs->text[outputs->length++] = '-';
+	while (i > 0) outputs->text[outputs->length++] = digits[--i];
+} /* appendNumber */
+
+/********************************************/
+int tmAppendOutput(TMOutputs* outputs, int value) {
+	static const char prefix[] = "OUT instruction prints: ";
+	if (!reserve(outputs, sizeof(prefix) + 12)) return FALSE;
+	if (!outputs->raw) {
+		memcpy(outputs->text + outputs->length, prefix, sizeof(prefix) - 1);
+		outputs->length += sizeof(prefix) - 1;
+	}
+	appendNumber(outputs, value);
+	outputs->text[outputs->length++] = '\n';
+	return TRUE;
+} /* tmAppendOutput */
+
+/********************************************/
+int tmAppendHalt(TMOutputs* outputs, int r, int s, int t) {
+	if (outputs->raw) return TRUE;
+	if (!reserve(outputs, 64)) return FALSE;
+	outputs->length += sprintf(outputs->text + outputs->length, "HALT: %1d,%1d,%1d\n", r, s, t);
+	return TRUE;
+} /* tmAppendHalt */
+
+/********************************************/
+int tmWriteOutputs(TMOutputs* outputs, FILE* f) {
+	long length     = outputs->length;
+	outputs->length = 0;
+	return (length == 0) || (fwrite(outputs->text, 1, length, f) == (size_t) length);
+} /* tmWriteOutputs */
+
+/********************************************/
+void tmFreeOutputs(TMOutputs* outputs) {
+	free(outputs->text);
+	outputs->text   = NULL;
+	outputs->length = 0;
+	outputs->size   = 0;
+} /* tmFreeOutputs */
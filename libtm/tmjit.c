@@ -0,0 +1,488 @@
+/****************************************************/
+/* File: tmjit.c                                    */
+/* x86-64 translation of TM programs                */
+/****************************************************/
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmint.h"
+
+#if HAVE_JIT
+#include <stddef.h>
+#include <sys/mman.h>
+
+/********************************************/
+/* x86-64 translation of the decoded instructions. Every iMem location gets its own native
+ * entry point, so fall-through and constant jumps are plain host jumps, while jumps to
+ * computed addresses (LD 7,-1(1) returns) go through a dispatcher indexed by jitEntry.
+ * Instruction limits are checked at backward and computed jumps only, so runJIT leaves the
+ * last instructions before a limit, at most the longest run between two checks, to the
+ * threaded engine. Instructions the
+ * translator does not handle (I/O, HALT, pc as an operand) leave native code with srOKAY and
+ * are executed by stepTM.
+ */
+
+/* state shared between runJIT and the generated code, which keeps its address in rbx */
+typedef struct {
+	long           steps;        /* instructions executed, lives in rbp while in native code */
+	long           stop;         /* steps value at which the instruction limit is reached */
+	int*           mem;          /* dMem, lives in r15 */
+	void**         entry;        /* native address of every iMem location, plus the end of iMem */
+	unsigned char* pages;        /* context->pages, flagged by every store */
+	int            memSize;      /* dMem size in words */
+	int            reg[NO_REGS]; /* TM registers 0..6 live in r8d..r14d */
+	long           rm, ra;       /* RM and RA instructions of the last native run, in rsi, rdi */
+	unsigned char* breakAt;      /* return address of the breakpoint call that left native code */
+} JITSTATE;
+
+/* translation in progress */
+typedef struct {
+	TMProgram*     program;
+	unsigned char* code;
+	int            len;
+	int            exit;     /* offset of the code that leaves native execution */
+	int            dispatch; /* offset of the computed jump dispatcher, target pc in eax */
+	int (*fixup)[2]; /* rel32 offset, iMem target; at most two per instruction */
+	int fixups;
+} JITBUF;
+
+/* worst case code per instruction plus stubs */
+#define JIT_CODE_SIZE(iSize) ((size_t) (iSize) * 112 + 4096)
+
+/* a breakpoint replaces the first bytes of its location with a call to the start of jitCode */
+#define JIT_BREAK_SIZE 5
+
+#define JIT_STEPS offsetof(JITSTATE, steps)
+#define JIT_STOP offsetof(JITSTATE, stop)
+#define JIT_MEM offsetof(JITSTATE, mem)
+#define JIT_ENTRY offsetof(JITSTATE, entry)
+#define JIT_PAGES offsetof(JITSTATE, pages)
+#define JIT_MEMSIZE offsetof(JITSTATE, memSize)
+#define JIT_REG(r) (offsetof(JITSTATE, reg) + 4 * (r))
+#define JIT_RM offsetof(JITSTATE, rm)
+#define JIT_RA offsetof(JITSTATE, ra)
+#define JIT_BREAK offsetof(JITSTATE, breakAt)
+
+static void jitByte(JITBUF* j, int b) {
+	j->code[j->len++] = (unsigned char) b;
+} /* jitByte */
+
+/* n bytes given as int arguments */
+static void jitBytes(JITBUF* j, int n, ...) {
+	va_list bytes;
+	va_start(bytes, n);
+	while (n-- > 0) jitByte(j, va_arg(bytes, int));
+	va_end(bytes);
+} /* jitBytes */
+
+static void jitPatch(JITBUF* j, int at, int v) {
+	memcpy(j->code + at, &v, 4);
+} /* jitPatch */
+
+static void jitInt(JITBUF* j, int v) {
+	jitPatch(j, j->len, v);
+	j->len += 4;
+} /* jitInt */
+
+/* rel32 operand of a jump to a known code offset */
+static void jitRel(JITBUF* j, int target) {
+	jitInt(j, target - (j->len + 4));
+} /* jitRel */
+
+/* jmp rel32 to the native code of an iMem location, patched once all are translated */
+static void jitJumpTo(JITBUF* j, int loc) {
+	jitByte(j, 0xE9);
+	j->fixup[j->fixups][0]   = j->len;
+	j->fixup[j->fixups++][1] = loc;
+	jitInt(j, 0);
+} /* jitJumpTo */
+
+/* mov eax, reg(s) ; ZERO_REG reads as 0 */
+static void jitLoadEax(JITBUF* j, int s) {
+	if (s == ZERO_REG)
+		jitBytes(j, 2, 0x31, 0xC0);
+	else
+		jitBytes(j, 3, 0x44, 0x89, 0xC0 | (s << 3));
+} /* jitLoadEax */
+
+/* mov ecx, reg(t) */
+static void jitLoadEcx(JITBUF* j, int t) {
+	jitBytes(j, 3, 0x44, 0x89, 0xC1 | (t << 3));
+} /* jitLoadEcx */
+
+/* mov reg(r), eax */
+static void jitStoreEax(JITBUF* j, int r) {
+	jitBytes(j, 3, 0x41, 0x89, 0xC0 | r);
+} /* jitStoreEax */
+
+/* eax = d + reg(s) */
+static void jitAddress(JITBUF* j, int d, int s) {
+	if (s == ZERO_REG) {
+		jitByte(j, 0xB8), jitInt(j, d);
+		return;
+	}
+	jitLoadEax(j, s);
+	if (d != 0) jitByte(j, 0x05), jitInt(j, d);
+} /* jitAddress */
+
+/* leave native code with result in eax after setting the TM pc to loc */
+static void jitLeave(JITBUF* j, int loc, STEPRESULT result) {
+	jitBytes(j, 3, 0xC7, 0x43, JIT_REG(PC_REG)), jitInt(j, loc);
+	jitByte(j, 0xB8), jitInt(j, result);
+	jitByte(j, 0xE9), jitRel(j, j->exit);
+} /* jitLeave */
+
+/* skip the following 17 byte jitLeave when the condition code cc holds */
+static void jitSkipLeave(JITBUF* j, int cc) {
+	jitBytes(j, 2, 0x70 | cc, 17);
+} /* jitSkipLeave */
+
+/* pc = d + reg(s), checking the instruction limit when going backwards or computed */
+static void jitJump(JITBUF* j, int loc, int d, int s) {
+	if ((s == ZERO_REG) && (d > loc) && (d < j->program->iSize)) {
+		jitJumpTo(j, d);
+		return;
+	}
+	if ((s == ZERO_REG) && (d >= 0) && (d < j->program->iSize)) {
+		jitBytes(j, 4, 0x48, 0x3B, 0x6B, JIT_STOP); /* cmp rbp, stop */
+		jitSkipLeave(j, 0xC);                       /* jl */
+		jitLeave(j, d, srBUDGET);
+		jitJumpTo(j, d);
+		return;
+	}
+	jitAddress(j, d, s);
+	jitByte(j, 0xE9), jitRel(j, j->dispatch);
+} /* jitJump */
+
+/* condition codes of jge, jg, jle, jl, jne, je: the negations of JLT .. JNE */
+static const int jitSkipCC[] = {0xD, 0xF, 0xE, 0xC, 0x5, 0x4};
+
+static void jitInstruction(JITBUF* j, int loc) {
+	const DECODED* ip = &j->program->dCode[loc];
+	int            skip;
+
+	j->program->jitEntry[loc] = j->code + j->len;
+	if (ip->kind == hSTEP) {
+		jitBytes(j, 3, 0xC7, 0x43, JIT_REG(PC_REG)), jitInt(j, loc);
+		jitBytes(j, 2, 0x31, 0xC0); /* xor eax, eax: srOKAY */
+		jitByte(j, 0xE9), jitRel(j, j->exit);
+		return;
+	}
+	jitBytes(j, 3, 0x48, 0xFF, 0xC5); /* inc rbp */
+	if ((ip->kind >= hLD) && (ip->kind <= hST))
+		jitBytes(j, 3, 0x48, 0xFF, 0xC6); /* inc rsi */
+	else if (ip->kind >= hLDA)
+		jitBytes(j, 3, 0x48, 0xFF, 0xC7); /* inc rdi */
+	switch (ip->kind) {
+		case hADD:
+		case hSUB:
+		case hMUL:
+			jitLoadEax(j, ip->s);
+			jitLoadEcx(j, ip->t);
+			if (ip->kind == hADD)
+				jitBytes(j, 2, 0x01, 0xC8);
+			else if (ip->kind == hSUB)
+				jitBytes(j, 2, 0x29, 0xC8);
+			else
+				jitBytes(j, 3, 0x0F, 0xAF, 0xC1);
+			jitStoreEax(j, ip->r);
+			break;
+
+		case hDIV:
+			jitLoadEax(j, ip->s);
+			jitLoadEcx(j, ip->t);
+			jitBytes(j, 2, 0x85, 0xC9); /* test ecx, ecx */
+			jitSkipLeave(j, 0x5);       /* jnz */
+			jitLeave(j, loc + 1, srZERODIVIDE);
+			jitBytes(j, 3, 0x83, 0xF9, 0xFF); /* cmp ecx, -1: idiv would trap */
+			jitBytes(j, 2, 0x75, 4);          /* jne */
+			jitBytes(j, 2, 0xF7, 0xD8);       /* neg eax */
+			jitBytes(j, 2, 0xEB, 3);          /* jmp */
+			jitByte(j, 0x99);                 /* cdq */
+			jitBytes(j, 2, 0xF7, 0xF9);       /* idiv ecx */
+			jitStoreEax(j, ip->r);
+			break;
+
+		case hLD:
+		case hLDPC:
+		case hST:
+			jitAddress(j, ip->d, ip->s);
+			jitBytes(j, 3, 0x3B, 0x43, JIT_MEMSIZE); /* cmp eax, memSize */
+			jitSkipLeave(j, 0x2);                    /* jb */
+			jitLeave(j, loc + 1, srDMEM_ERR);
+			if (ip->kind == hST) {
+				jitBytes(j, 2, 0x89, 0xC2);                    /* mov edx, eax */
+				jitBytes(j, 3, 0xC1, 0xEA, DPAGE_SHIFT);       /* shr edx, DPAGE_SHIFT */
+				jitBytes(j, 4, 0x48, 0x8B, 0x4B, JIT_PAGES);   /* mov rcx, pages */
+				jitBytes(j, 4, 0xF6, 0x04, 0x11, DPAGE_WATCH); /* test byte [rcx+rdx], watch */
+				jitBytes(j, 2, 0x74, 6 + 17);                  /* jz */
+				jitBytes(j, 6, 0x48, 0xFF, 0xCD, 0x48, 0xFF, 0xCE); /* dec rbp; dec rsi */
+				jitLeave(j, loc, srOKAY); /* stepTM executes stores into watched pages */
+				jitBytes(j, 4, 0xC6, 0x04, 0x11, DPAGE_STORE); /* mov byte [rcx+rdx], flags */
+				jitLoadEcx(j, ip->r);
+				jitBytes(j, 4, 0x41, 0x89, 0x0C, 0x87); /* mov [r15+rax*4], ecx */
+				break;
+			}
+			jitBytes(j, 4, 0x41, 0x8B, 0x04, 0x87); /* mov eax, [r15+rax*4] */
+			if (ip->kind == hLDPC)
+				jitByte(j, 0xE9), jitRel(j, j->dispatch);
+			else
+				jitStoreEax(j, ip->r);
+			break;
+
+		case hLDA:
+			jitAddress(j, ip->d, ip->s);
+			jitStoreEax(j, ip->r);
+			break;
+
+		case hLDC:
+			jitBytes(j, 2, 0x41, 0xB8 | ip->r), jitInt(j, ip->d); /* mov reg(r), imm32 */
+			break;
+
+		case hJMP:
+			jitJump(j, loc, ip->d, ip->s);
+			break;
+
+		default: /* conditional jumps: test reg(r) and skip the jump unless the condition holds */
+			jitLoadEax(j, ip->r);
+			jitBytes(j, 2, 0x85, 0xC0); /* test eax, eax */
+			jitBytes(j, 2, 0x0F, 0x80 | jitSkipCC[ip->kind - hJLT]);
+			skip = j->len;
+			jitInt(j, 0);
+			jitJump(j, loc, ip->d, ip->s);
+			jitPatch(j, skip, j->len - (skip + 4));
+			break;
+	}
+} /* jitInstruction */
+
+/* Longest run of instructions native code can execute from some location up to and including
+ * the next limit check: fall-through and forward constant jumps go on, backward and computed
+ * jumps and the end of iMem check, instructions left to stepTM end the run before them. -1 if
+ * out of memory.
+ */
+static int jitLongestRun(const TMProgram* program) {
+	const DECODED* ip;
+	int*           run = malloc(((size_t) program->iSize + 1) * sizeof(int));
+	int            loc, next, longest = 0;
+
+	if (run == NULL) return -1;
+	run[program->iSize] = 0;
+	for (loc = program->iSize - 1; loc >= 0; loc--) {
+		ip   = &program->dCode[loc];
+		next = ((ip->kind == hJMP) || (ip->kind == hLDPC)) ? 0 : run[loc + 1];
+		if ((ip->kind >= hJMP) && (ip->s == ZERO_REG) && (ip->d > loc) &&
+		    (ip->d < program->iSize) && (run[ip->d] > next))
+			next = run[ip->d];
+		run[loc] = (ip->kind == hSTEP) ? 0 : 1 + next;
+		if (run[loc] > longest) longest = run[loc];
+	}
+	free(run);
+	return longest;
+} /* jitLongestRun */
+
+/* write or remove the breakpoint call at loc in writable code */
+static void jitBreakpoint(TMProgram* program, int loc, int on) {
+	unsigned char* at    = program->jitEntry[loc];
+	unsigned char* saved = program->jitSaved + (size_t) loc * JIT_BREAK_SIZE;
+	int            rel;
+	if (!on) {
+		memcpy(at, saved, JIT_BREAK_SIZE);
+		return;
+	}
+	memcpy(saved, at, JIT_BREAK_SIZE);
+	rel   = (int) (program->jitCode - (at + JIT_BREAK_SIZE));
+	at[0] = 0xE8; /* call rel32 */
+	memcpy(at + 1, &rel, 4);
+} /* jitBreakpoint */
+
+/********************************************/
+int tmTranslate(TMProgram* program) {
+	JITBUF* j;
+	int     loc, i;
+
+	if (program->jitCode != NULL) return TRUE;
+	program->jitStretch = jitLongestRun(program);
+	if (program->jitStretch < 0) return FALSE;
+	j = malloc(sizeof(JITBUF));
+	if (j == NULL) return FALSE;
+	j->program = program;
+	j->code    = mmap(NULL, JIT_CODE_SIZE(program->iSize), PROT_READ | PROT_WRITE,
+	                  MAP_PRIVATE | MAP_ANON, -1, 0);
+	j->len     = 0;
+	j->fixup   = malloc((size_t) program->iSize * 2 * sizeof(j->fixup[0]));
+	j->fixups  = 0;
+	program->jitSaved = malloc((size_t) program->iSize * JIT_BREAK_SIZE + 1);
+	if ((j->code == MAP_FAILED) || (j->fixup == NULL) || (program->jitSaved == NULL)) {
+		if (j->code != MAP_FAILED) munmap(j->code, JIT_CODE_SIZE(program->iSize));
+		free(j->fixup);
+		free(j);
+		free(program->jitSaved);
+		program->jitSaved = NULL;
+		return FALSE;
+	}
+
+	/* breakpoint: called from the location, keep the return address and fall into exit */
+	jitByte(j, 0x58);                               /* pop rax */
+	jitBytes(j, 4, 0x48, 0x89, 0x43, JIT_BREAK);    /* mov breakAt, rax */
+	jitByte(j, 0xB8), jitInt(j, srBREAK);
+
+	/* exit: spill TM registers and the step count, restore callee-saved registers */
+	j->exit = j->len;
+	for (i = 0; i < PC_REG; i++) /* mov [rbx+reg], r8d+i */
+		jitBytes(j, 4, 0x44, 0x89, 0x43 | (i << 3), JIT_REG(i));
+	jitBytes(j, 4, 0x48, 0x89, 0x6B, JIT_STEPS);
+	jitBytes(j, 4, 0x48, 0x89, 0x73, JIT_RM);
+	jitBytes(j, 4, 0x48, 0x89, 0x7B, JIT_RA);
+	jitBytes(j, 6, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D);
+	jitBytes(j, 5, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+
+	/* dispatch: pc in eax; limit check, then iMem bounds check as in stepTM */
+	j->dispatch = j->len;
+	jitBytes(j, 3, 0x89, 0x43, JIT_REG(PC_REG));    /* mov pc, eax */
+	jitBytes(j, 4, 0x48, 0x3B, 0x6B, JIT_STOP);     /* cmp rbp, stop */
+	jitBytes(j, 2, 0x7C, 10);                       /* jl */
+	jitByte(j, 0xB8), jitInt(j, srBUDGET);
+	jitByte(j, 0xE9), jitRel(j, j->exit);
+	jitByte(j, 0x3D), jitInt(j, program->iSize);    /* cmp eax, iSize */
+	jitBytes(j, 2, 0x72, 13);                       /* jb */
+	jitBytes(j, 3, 0x48, 0xFF, 0xC5);               /* inc rbp */
+	jitByte(j, 0xB8), jitInt(j, srIMEM_ERR);
+	jitByte(j, 0xE9), jitRel(j, j->exit);
+	jitBytes(j, 4, 0x48, 0x8B, 0x4B, JIT_ENTRY);    /* mov rcx, entry */
+	jitBytes(j, 3, 0xFF, 0x24, 0xC1);               /* jmp [rcx+rax*8] */
+
+	/* entry point: save callee-saved registers, load state and dispatch to the pc */
+	program->jitStart = j->code + j->len;
+	jitBytes(j, 6, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55);
+	jitBytes(j, 4, 0x41, 0x56, 0x41, 0x57);
+	jitBytes(j, 3, 0x48, 0x89, 0xFB);               /* mov rbx, rdi */
+	jitBytes(j, 4, 0x48, 0x8B, 0x6B, JIT_STEPS);    /* mov rbp, steps */
+	jitBytes(j, 4, 0x4C, 0x8B, 0x7B, JIT_MEM);      /* mov r15, mem */
+	jitBytes(j, 4, 0x31, 0xF6, 0x31, 0xFF);         /* xor esi, esi; xor edi, edi */
+	for (i = 0; i < PC_REG; i++) /* mov r8d+i, [rbx+reg] */
+		jitBytes(j, 4, 0x44, 0x8B, 0x43 | (i << 3), JIT_REG(i));
+	jitBytes(j, 3, 0x8B, 0x43, JIT_REG(PC_REG));    /* mov eax, pc */
+	jitByte(j, 0xE9), jitRel(j, j->dispatch);
+
+	for (loc = 0; loc < program->iSize; loc++) jitInstruction(j, loc);
+	/* falling off the end of iMem */
+	program->jitEntry[program->iSize] = j->code + j->len;
+	jitByte(j, 0xB8), jitInt(j, program->iSize);
+	jitByte(j, 0xE9), jitRel(j, j->dispatch);
+
+	for (i = 0; i < j->fixups; i++) {
+		loc = (int) ((unsigned char*) program->jitEntry[j->fixup[i][1]] - j->code);
+		jitPatch(j, j->fixup[i][0], loc - (j->fixup[i][0] + 4));
+	}
+	program->jitCode = j->code;
+	free(j->fixup);
+	free(j);
+	for (loc = 0; loc < program->iSize; loc++)
+		if (tmBreakpointAt(program, loc)) jitBreakpoint(program, loc, TRUE);
+	if (mprotect(program->jitCode, JIT_CODE_SIZE(program->iSize), PROT_READ | PROT_EXEC) != 0) {
+		freeJIT(program);
+		return FALSE;
+	}
+	return TRUE;
+} /* tmTranslate */
+
+/********************************************/
+void freeJIT(TMProgram* program) {
+	if (program->jitCode != NULL) munmap(program->jitCode, JIT_CODE_SIZE(program->iSize));
+	free(program->jitSaved);
+	program->jitCode  = NULL;
+	program->jitStart = NULL;
+	program->jitSaved = NULL;
+} /* freeJIT */
+
+/********************************************/
+int patchJIT(TMProgram* program, int loc, int on) {
+	if (program->jitCode == NULL) return TRUE;
+	if (mprotect(program->jitCode, JIT_CODE_SIZE(program->iSize), PROT_READ | PROT_WRITE) != 0)
+		return FALSE;
+	jitBreakpoint(program, loc, on);
+	return mprotect(program->jitCode, JIT_CODE_SIZE(program->iSize), PROT_READ | PROT_EXEC) == 0;
+} /* patchJIT */
+
+/* location whose breakpoint call returns to at */
+static int breakLocation(const TMProgram* program, const unsigned char* at) {
+	int low = 0, high = program->iSize - 1, mid;
+	at -= JIT_BREAK_SIZE;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if ((unsigned char*) program->jitEntry[mid] < at)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+} /* breakLocation */
+
+/********************************************/
+/* Between two limit checks native code runs at most jitStretch instructions, so it executes
+ * fewer than that past its stop. It is given a stop that much earlier, and the threaded engine
+ * runs on from there to the exact limit; a budget no larger than jitStretch runs threaded.
+ */
+STEPRESULT runJIT(TMContext* context, long stop) {
+	int (*enter)(JITSTATE*);
+	JITSTATE   jitState;
+	STEPRESULT stepResult;
+	long       start;
+
+	if ((context->program->jitCode == NULL) ||
+	    (stop - context->steps <= context->program->jitStretch))
+		return runThreaded(context, stop, NULL);
+	enter            = (int (*)(JITSTATE*)) context->program->jitStart;
+	jitState.steps   = context->steps;
+	jitState.stop    = stop - context->program->jitStretch;
+	jitState.mem     = context->dMem;
+	jitState.memSize = context->dSize;
+	jitState.entry   = context->program->jitEntry;
+	jitState.pages   = context->pages;
+	memcpy(jitState.reg, context->reg, sizeof(jitState.reg));
+	for (;;) {
+		start      = jitState.steps;
+		stepResult = enter(&jitState);
+		/* RR instructions are what remains of the native steps, less an iMem fault */
+		context->classCount[opclRR] += jitState.steps - start - jitState.rm - jitState.ra -
+		                               (stepResult == srIMEM_ERR);
+		context->classCount[opclRM] += jitState.rm;
+		context->classCount[opclRA] += jitState.ra;
+		if (stepResult == srBREAK)
+			jitState.reg[PC_REG] = breakLocation(context->program, jitState.breakAt);
+		if (stepResult != srOKAY) break;
+		/* an instruction left to the interpreter */
+		if (jitState.steps >= jitState.stop) {
+			stepResult = srBUDGET;
+			break;
+		}
+		memcpy(context->reg, jitState.reg, sizeof(jitState.reg));
+		stepResult = stepTM(context);
+		memcpy(jitState.reg, context->reg, sizeof(jitState.reg));
+		jitState.steps++;
+		if (stepResult != srOKAY) break;
+	}
+	memcpy(context->reg, jitState.reg, sizeof(jitState.reg));
+	context->steps = jitState.steps;
+	if (stepResult == srBUDGET) return runThreaded(context, stop, NULL);
+	return stepResult;
+} /* runJIT */
+#else
+int tmTranslate(TMProgram* program) {
+	return FALSE;
+} /* tmTranslate */
+
+void freeJIT(TMProgram* program) {
+} /* freeJIT */
+
+int patchJIT(TMProgram* program, int loc, int on) {
+	return TRUE;
+} /* patchJIT */
+
+STEPRESULT runJIT(TMContext* context, long stop) {
+	return runThreaded(context, stop, NULL);
+} /* runJIT */
+#endif
@@ -0,0 +1,431 @@
+/****************************************************/
+/* File: tmlanes.c                                  */
+/* Lockstep execution of one TM program on many     */
+/* inputs                                           */
+/****************************************************/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "tmint.h"
+
+/* lanes per vector operation; rows are padded to a multiple of it */
+#define LANE_VECTOR 8
+
+/* instructions run between two looks at the clock when a lane has a time limit */
+#define LANES_SLICE (1L << 16)
+
+/* row of the instructions that stepTM counts by class itself, or that fault at fetch */
+#define LANE_OTHER 3
+
+typedef int LANEVEC __attribute__((vector_size(LANE_VECTOR * sizeof(int))));
+
+/********************************************/
+/* Registers and data memory are structure-of-arrays: word a of lane l is dMem[a * stride + l],
+ * so an instruction executed by every lane is a loop of vector operations over consecutive
+ * words. Lanes run in lockstep while they are at the same pc. When a jump sends them apart,
+ * each instruction runs for the lanes at the lowest pc only, masking the others, which lets
+ * the lanes behind catch up and join again where the paths meet.
+ */
+struct TMLanes {
+	const TMProgram* program;
+	TMContext**      lane;   /* per lane callbacks, and its state after tmLanesRun */
+	int              count;  /* number of lanes */
+	int              stride; /* count rounded up to LANE_VECTOR; the lanes above never run */
+	int              dSize;  /* data memory words of every lane */
+	int*             reg;    /* NO_REGS + 1 rows; row ZERO_REG stays zero. Then the mask row: */
+	int*             mask;   /* -1 for a lane at the pc being executed, 0 otherwise */
+	int*             dMem;   /* dSize rows */
+	unsigned char*   pages;  /* DPAGE_WRITTEN for each page of rows written by any lane */
+	int*             pc;     /* of every lane; not kept up to date while they are together */
+	unsigned char*   live;   /* lane has not stopped */
+	long*            counts; /* rows opclRR, opclRM, opclRA and LANE_OTHER of instructions */
+};
+
+#define ROW(base, r) ((base) + (size_t) (r) * lanes->stride)
+#define VECTORS(base, r) ((LANEVEC*) ROW(base, r))
+
+/********************************************/
+TMLanes* tmLanesNew(const TMProgram* program, int count, int dSize) {
+	TMLanes* lanes = calloc(1, sizeof(TMLanes));
+	int      l;
+	if (lanes == NULL) return NULL;
+	lanes->program = program;
+	lanes->count   = (count > 0) ? count : 1;
+	lanes->stride  = (lanes->count + LANE_VECTOR - 1) / LANE_VECTOR * LANE_VECTOR;
+	lanes->dSize   = (dSize > 0) ? dSize : DADDR_SIZE;
+	lanes->lane    = calloc(lanes->count, sizeof(TMContext*));
+	lanes->reg     = mapMemory((size_t) (NO_REGS + 2) * lanes->stride);
+	lanes->dMem    = mapMemory((size_t) lanes->dSize * lanes->stride);
+	lanes->pages   = calloc(DPAGES(lanes->dSize), 1);
+	lanes->pc      = calloc(lanes->count, sizeof(int));
+	lanes->live    = calloc(lanes->count, 1);
+	lanes->counts  = calloc(4 * lanes->stride, sizeof(long));
+	if ((lanes->lane == NULL) || (lanes->reg == NULL) || (lanes->dMem == NULL) ||
+	    (lanes->pages == NULL) || (lanes->pc == NULL) || (lanes->live == NULL) ||
+	    (lanes->counts == NULL)) {
+		tmLanesFree(lanes);
+		return NULL;
+	}
+	lanes->mask = ROW(lanes->reg, NO_REGS + 1);
+	for (l = 0; l < lanes->count; l++) {
+		lanes->lane[l] = tmContextNew(program, lanes->dSize);
+		if (lanes->lane[l] == NULL) {
+			tmLanesFree(lanes);
+			return NULL;
+		}
+	}
+	return lanes;
+} /* tmLanesNew */
+
+/********************************************/
+void tmLanesFree(TMLanes* lanes) {
+	int l;
+	if (lanes == NULL) return;
+	if (lanes->lane != NULL)
+		for (l = 0; l < lanes->count; l++) tmContextFree(lanes->lane[l]);
+	if (lanes->reg != NULL)
+		munmap(lanes->reg, (size_t) (NO_REGS + 2) * lanes->stride * sizeof(int));
+	if (lanes->dMem != NULL)
+		munmap(lanes->dMem, (size_t) lanes->dSize * lanes->stride * sizeof(int));
+	free(lanes->lane);
+	free(lanes->pages);
+	free(lanes->pc);
+	free(lanes->live);
+	free(lanes->counts);
+	free(lanes);
+} /* tmLanesFree */
+
+/********************************************/
+TMContext* tmLane(TMLanes* lanes, int lane) {
+	return lanes->lane[lane];
+} /* tmLane */
+
+/* every lane at the start of the program, as tmReset leaves a context */
+static void startLanes(TMLanes* lanes) {
+	const TMProgram* program = lanes->program;
+	int              p, l, i, a;
+	for (p = 0; p < DPAGES(lanes->dSize); p++)
+		if (lanes->pages[p]) {
+			memset(ROW(lanes->dMem, p << DPAGE_SHIFT), 0,
+			       (size_t) lanes->stride * sizeof(int) << DPAGE_SHIFT);
+			lanes->pages[p] = 0;
+		}
+	lanes->pages[0] = DPAGE_WRITTEN;
+	for (l = 0; l < lanes->stride; l++) lanes->dMem[l] = lanes->dSize - 1;
+	for (i = 0; i < program->dataCount; i++) {
+		a = program->dataImage[i].address;
+		if (a >= lanes->dSize) continue;
+		for (l = 0; l < lanes->stride; l++) ROW(lanes->dMem, a)[l] = program->dataImage[i].value;
+		lanes->pages[a >> DPAGE_SHIFT] = DPAGE_WRITTEN;
+	}
+	memset(lanes->reg, 0, (size_t) (NO_REGS + 2) * lanes->stride * sizeof(int));
+	memset(lanes->pc, 0, lanes->count * sizeof(int));
+	memset(lanes->live, TRUE, lanes->count);
+	memset(lanes->counts, 0, 4 * lanes->stride * sizeof(long));
+	for (l = 0; l < lanes->count; l++) {
+		lanes->lane[l]->program = program;
+		tmReset(lanes->lane[l]);
+	}
+} /* startLanes */
+
+/* add the instructions counted once for all lanes to each lane */
+static void flushCounts(TMLanes* lanes, long* pending) {
+	int r, l;
+	for (r = 0; r < 4; r++) {
+		for (l = 0; l < lanes->count; l++) ROW(lanes->counts, r)[l] += pending[r];
+		pending[r] = 0;
+	}
+} /* flushCounts */
+
+/* instructions lane l has executed */
+static long laneSteps(const TMLanes* lanes, int l) {
+	return ROW(lanes->counts, opclRR)[l] + ROW(lanes->counts, opclRM)[l] +
+	       ROW(lanes->counts, opclRA)[l] + ROW(lanes->counts, LANE_OTHER)[l];
+} /* laneSteps */
+
+/* copy the registers, counts and written data memory of a stopped lane to its context */
+static void finishLane(TMLanes* lanes, int l) {
+	TMContext* context = lanes->lane[l];
+	int        r, p, a, last;
+	for (r = 0; r < PC_REG; r++) context->reg[r] = ROW(lanes->reg, r)[l];
+	context->reg[PC_REG] = lanes->pc[l];
+	context->steps       = laneSteps(lanes, l);
+	for (r = 0; r < 3; r++) context->classCount[r] += ROW(lanes->counts, r)[l];
+	for (p = 0; p < DPAGES(lanes->dSize); p++) {
+		if (!lanes->pages[p]) continue;
+		last = (p + 1) << DPAGE_SHIFT;
+		if (last > lanes->dSize) last = lanes->dSize;
+		for (a = p << DPAGE_SHIFT; a < last; a++) context->dMem[a] = ROW(lanes->dMem, a)[l];
+		context->pages[p] |= DPAGE_STORE;
+	}
+} /* finishLane */
+
+/********************************************/
+/* Each instruction updates only the lanes in the mask. While every lane is in it, the loops of
+ * RR and RA instructions need no mask, a load or store whose address is the same in every lane
+ * moves a whole row, and instructions are counted once for all lanes, in pending.
+ */
+void tmLanesRun(TMLanes* lanes, long budget, STEPRESULT* results) {
+	const DECODED* dCode      = lanes->program->dCode;
+	int            n          = lanes->count;
+	int            vectors    = lanes->stride / LANE_VECTOR;
+	int*           lanePc     = lanes->pc;
+	unsigned char* live       = lanes->live;
+	int*           mask       = lanes->mask;
+	LANEVEC*       M          = (LANEVEC*) mask;
+	LANEVEC        zero       = {0};
+	long           pending[4] = {0, 0, 0, 0};
+	const DECODED* ip;
+	TMContext*     context;
+	STEPRESULT     stepResult;
+	LANEVEC*       A;
+	LANEVEC*       B;
+	LANEVEC*       C;
+	LANEVEC        differ;
+	long*          count;
+	long           stop, iterations = 0, start = 0, now;
+	int            liveCount, active, together, full, timed = FALSE;
+	int            pc = 0, next, m, l, v, r, row, stepped;
+
+	startLanes(lanes);
+	stop = (budget > 0) ? budget : LONG_MAX;
+	for (l = 0; l < n; l++) {
+		mask[l] = -1;
+		if (lanes->lane[l]->timeLimit > 0) timed = TRUE;
+	}
+	if (timed) start = clockMillis();
+	liveCount = active = n;
+	together  = full = TRUE;
+
+/* a lane of the mask stops with result, its pc at the instruction or after it */
+#define STOP(l, result, at)                         \
+	do {                                            \
+		if (full) flushCounts(lanes, pending);      \
+		results[l] = (result);                      \
+		lanePc[l]  = (at);                          \
+		live[l]    = FALSE;                         \
+		mask[l]    = 0;                             \
+		liveCount--;                                \
+		active--;                                   \
+		full = FALSE;                               \
+	} while (0)
+/* A = expr for the lanes of the mask */
+#define LANES(expr)                                          \
+	do {                                                     \
+		A = VECTORS(lanes->reg, ip->r);                      \
+		B = VECTORS(lanes->reg, ip->s);                      \
+		C = VECTORS(lanes->reg, ip->t);                      \
+		if (full)                                            \
+			for (v = 0; v < vectors; v++) A[v] = (expr);     \
+		else                                                 \
+			for (v = 0; v < vectors; v++)                    \
+				A[v] = ((expr) & M[v]) | (A[v] & ~M[v]);     \
+	} while (0)
+
+	while (liveCount > 0) {
+		if (!together) {
+			/* the lanes at the lowest pc go first */
+			if (full) flushCounts(lanes, pending);
+			pc = INT_MAX;
+			for (l = 0; l < n; l++)
+				if (live[l] && (lanePc[l] < pc)) pc = lanePc[l];
+			active = 0;
+			for (l = 0; l < n; l++) {
+				mask[l] = (live[l] && (lanePc[l] == pc)) ? -1 : 0;
+				active -= mask[l];
+			}
+			together = (active == liveCount);
+			full     = (active == n);
+		}
+		/* no lane has run more instructions than the loop */
+		if (iterations >= stop) {
+			if (full) flushCounts(lanes, pending);
+			for (l = 0; l < n; l++)
+				if (mask[l] && (laneSteps(lanes, l) >= stop)) STOP(l, srBUDGET, pc);
+		}
+		iterations++;
+		if (timed && (iterations % LANES_SLICE == 0)) {
+			now = clockMillis();
+			for (l = 0; l < n; l++)
+				if (mask[l] && (lanes->lane[l]->timeLimit > 0) &&
+				    (now - start >= lanes->lane[l]->timeLimit))
+					STOP(l, srTIMEOUT, pc);
+		}
+		if (active == 0) {
+			together = FALSE;
+			continue;
+		}
+		ip      = &dCode[pc];
+		stepped = ((unsigned) pc >= (unsigned) lanes->program->iSize) ||
+		          ((ip->kind == hSTEP) && (lanes->program->iMem[pc].iop != opST));
+		if (stepped)
+			row = LANE_OTHER;
+		else if (ip->kind == hSTEP) /* ST 7,d(s), which needs the lanes' dMem */
+			row = opclRM;
+		else
+			row = (ip->kind <= hDIV) ? opclRR : (ip->kind <= hST) ? opclRM : opclRA;
+		if (full)
+			pending[row]++;
+		else {
+			count = ROW(lanes->counts, row);
+			for (l = 0; l < n; l++) count[l] -= mask[l];
+		}
+		if ((unsigned) pc >= (unsigned) lanes->program->iSize) {
+			for (l = 0; l < n; l++)
+				if (mask[l]) STOP(l, srIMEM_ERR, pc);
+			together = FALSE;
+			continue;
+		}
+		next = pc + 1;
+		switch (((ip->kind == hSTEP) && !stepped) ? hST : ip->kind) {
+			case hADD:
+				LANES(B[v] + C[v]);
+				break;
+			case hSUB:
+				LANES(B[v] - C[v]);
+				break;
+			case hMUL:
+				LANES(B[v] * C[v]);
+				break;
+			case hLDA:
+				LANES(B[v] + ip->d);
+				break;
+			case hLDC:
+				LANES(zero + ip->d);
+				break;
+
+			case hDIV:
+				/***********************************/
+				for (l = 0; l < n; l++) {
+					if (!mask[l]) continue;
+					if (ROW(lanes->reg, ip->t)[l] == 0)
+						STOP(l, srZERODIVIDE, next);
+					else
+						ROW(lanes->reg, ip->r)[l] =
+						    ROW(lanes->reg, ip->s)[l] / ROW(lanes->reg, ip->t)[l];
+				}
+				break;
+
+			case hLD:
+			case hST:
+			case hLDPC:
+				/***********************************/
+				A = VECTORS(lanes->reg, ip->r);
+				B = VECTORS(lanes->reg, ip->s);
+				m = ip->d + ROW(lanes->reg, ip->s)[0];
+				if (full && (ip->kind != hLDPC) && ((unsigned) m < (unsigned) lanes->dSize)) {
+					/* the same address in every lane: move a row */
+					differ = zero;
+					for (v = 0; v < vectors; v++) differ |= (B[v] - (m - ip->d)) & M[v];
+					for (l = 0; (l < LANE_VECTOR) && !differ[l]; l++)
+						;
+					if (l == LANE_VECTOR) {
+						C = VECTORS(lanes->dMem, m);
+						if (ip->kind == hLD)
+							for (v = 0; v < vectors; v++) A[v] = C[v];
+						else {
+							for (v = 0; v < vectors; v++)
+								C[v] = (ip->kind == hST) ? A[v] : zero + next;
+							lanes->pages[m >> DPAGE_SHIFT] = DPAGE_WRITTEN;
+						}
+						break;
+					}
+				}
+				for (l = 0; l < n; l++) {
+					if (!mask[l]) continue;
+					m = ip->d + ROW(lanes->reg, ip->s)[l];
+					if ((unsigned) m >= (unsigned) lanes->dSize)
+						STOP(l, srDMEM_ERR, next);
+					else if (ip->kind == hLD)
+						ROW(lanes->reg, ip->r)[l] = ROW(lanes->dMem, m)[l];
+					else if (ip->kind == hLDPC)
+						lanePc[l] = ROW(lanes->dMem, m)[l];
+					else {
+						ROW(lanes->dMem, m)[l] =
+						    (ip->kind == hST) ? ROW(lanes->reg, ip->r)[l] : next;
+						lanes->pages[m >> DPAGE_SHIFT] = DPAGE_WRITTEN;
+					}
+				}
+				break;
+
+			case hSTEP:
+				/***********************************/
+				/* I/O, HALT and the pc as an operand: the step engine, in the lane's context */
+				for (l = 0; l < n; l++) {
+					if (!mask[l]) continue;
+					context = lanes->lane[l];
+					for (r = 0; r < PC_REG; r++) context->reg[r] = ROW(lanes->reg, r)[l];
+					context->reg[PC_REG] = pc;
+					stepResult           = stepTM(context);
+					for (r = 0; r < PC_REG; r++) ROW(lanes->reg, r)[l] = context->reg[r];
+					lanePc[l] = context->reg[PC_REG];
+					if (stepResult != srOKAY) STOP(l, stepResult, lanePc[l]);
+				}
+				break;
+
+			default:
+				/***********************************/
+				/* jumps */
+				for (l = 0; l < n; l++) {
+					if (!mask[l]) continue;
+					m = ROW(lanes->reg, ip->r)[l];
+					switch (ip->kind) {
+						case hJLT:
+							m = m < 0;
+							break;
+						case hJLE:
+							m = m <= 0;
+							break;
+						case hJGT:
+							m = m > 0;
+							break;
+						case hJGE:
+							m = m >= 0;
+							break;
+						case hJEQ:
+							m = m == 0;
+							break;
+						case hJNE:
+							m = m != 0;
+							break;
+						default: /* hJMP */
+							m = TRUE;
+							break;
+					}
+					lanePc[l] = m ? ip->d + ROW(lanes->reg, ip->s)[l] : next;
+				}
+				break;
+		}
+		if (!stepped && (ip->kind != hLDPC) && (ip->kind < hJMP)) {
+			/* no jump: the lanes of the mask go on to the next location */
+			if (together) {
+				pc = next;
+				continue;
+			}
+			for (l = 0; l < n; l++)
+				if (mask[l]) lanePc[l] = next;
+			continue;
+		}
+		/* the lanes of the mask stay together if they all went to the same location */
+		if (together) {
+			for (l = 0; (l < n) && !mask[l]; l++)
+				;
+			if (l == n) continue;
+			next = lanePc[l];
+			for (; l < n; l++)
+				if (mask[l] && (lanePc[l] != next)) break;
+			if (l == n) {
+				pc = next;
+				continue;
+			}
+			together = FALSE;
+		}
+	}
+#undef LANES
+#undef STOP
+
+	for (l = 0; l < n; l++) finishLane(lanes, l);
+} /* tmLanesRun */
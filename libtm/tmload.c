@@ -0,0 +1,583 @@
+/****************************************************/
+/* File: tmload.c                                   */
+/* Loading and pre-decoding of TM programs          */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tmint.h"
+#include "tmo.h"
+
+/******** vars ********/
+char* tmOpCodeTab[] = {
+    "HALT", "IN", "OUT", "ADD", "SUB", "MUL", "DIV", "????",
+    /* RR opcodes */
+    "LD", "ST", "????", /* RM opcodes */
+    "LDA", "LDC", "JLT", "JLE", "JGT", "JGE", "JEQ", "JNE", "????"
+    /* RA opcodes */
+};
+
+char* tmResultTab[] = {"OK",           "Halted",          "Instruction Memory Fault",
+                       "Data Memory Fault", "Division by 0", "Instruction Limit Exceeded",
+                       "Input Exhausted",   "Time Limit Exceeded", "Breakpoint",
+                       "Watchpoint"};
+
+int tmExitTab[] = {1, 0, 2, 3, 4, 5, 6, 7, 8, 9};
+
+char* tmEngineTab[] = {"step", "threaded", "jit"};
+
+/********************************************/
+int tmOpClass(int c) {
+	if (c <= opRRLim)
+		return (opclRR);
+	else if (c <= opRMLim)
+		return (opclRM);
+	else
+		return (opclRA);
+} /* tmOpClass */
+
+/********************************************/
+void tmScanLine(TMScanner* sc, const char* line, int length) {
+	while ((length > 0) && ((line[length - 1] == '\n') || (line[length - 1] == '\r'))) length--;
+	sc->line    = line;
+	sc->lineLen = length;
+	sc->inCol   = 0;
+} /* tmScanLine */
+
+/********************************************/
+static void getCh(TMScanner* sc) {
+	if (++sc->inCol < sc->lineLen)
+		sc->ch = sc->line[sc->inCol];
+	else
+		sc->ch = ' ';
+} /* getCh */
+
+/********************************************/
+static int nonBlank(TMScanner* sc) {
+	while ((sc->inCol < sc->lineLen) && (sc->line[sc->inCol] == ' ')) sc->inCol++;
+	if (sc->inCol < sc->lineLen) {
+		sc->ch = sc->line[sc->inCol];
+		return TRUE;
+	} else {
+		sc->ch = ' ';
+		return FALSE;
+	}
+} /* nonBlank */
+
+/********************************************/
+int tmGetNum(TMScanner* sc) {
+	int sign;
+	int term;
+	int temp = FALSE;
+	sc->num  = 0;
+	do {
+		sign = 1;
+		while (nonBlank(sc) && ((sc->ch == '+') || (sc->ch == '-'))) {
+			temp = FALSE;
+			if (sc->ch == '-') sign = -sign;
+			getCh(sc);
+		}
+		term = 0;
+		nonBlank(sc);
+		while (isdigit(sc->ch)) {
+			temp = TRUE;
+			term = term * 10 + (sc->ch - '0');
+			getCh(sc);
+		}
+		sc->num = sc->num + (term * sign);
+	} while ((nonBlank(sc)) && ((sc->ch == '+') || (sc->ch == '-')));
+	return temp;
+} /* tmGetNum */
+
+/********************************************/
+int tmGetWord(TMScanner* sc) {
+	int temp   = FALSE;
+	int length = 0;
+	if (nonBlank(sc)) {
+		while (isalnum(sc->ch)) {
+			if (length < WORDSIZE - 1) sc->word[length++] = sc->ch;
+			getCh(sc);
+		}
+		sc->word[length] = '\0';
+		temp             = (length != 0);
+	}
+	return temp;
+} /* tmGetWord */
+
+/********************************************/
+int tmSkipCh(TMScanner* sc, char c) {
+	int temp = FALSE;
+	if (nonBlank(sc) && (sc->ch == c)) {
+		getCh(sc);
+		temp = TRUE;
+	}
+	return temp;
+} /* tmSkipCh */
+
+/********************************************/
+int tmAtEOL(TMScanner* sc) {
+	return (!nonBlank(sc));
+} /* tmAtEOL */
+
+/********************************************/
+/* record why a load failed; always returns FALSE */
+static int error(TMProgram* program, char* msg, int lineNo, int instNo) {
+	char where[64] = "";
+	if ((lineNo > 0) && (instNo >= 0))
+		snprintf(where, sizeof(where), "Line %d (Instruction %d)   ", lineNo, instNo);
+	else if (lineNo > 0)
+		snprintf(where, sizeof(where), "Line %d   ", lineNo);
+	else if (instNo >= 0)
+		snprintf(where, sizeof(where), "Instruction %d   ", instNo);
+	snprintf(program->error, sizeof(program->error), "%s%s", where, msg);
+	return FALSE;
+} /* error */
+
+/********************************************/
+TMProgram* tmProgramNew(int iSize) {
+	TMProgram* program = calloc(1, sizeof(TMProgram));
+	if (program == NULL) return NULL;
+	program->iSize    = (iSize > 0) ? iSize : IADDR_SIZE;
+	program->iMem     = calloc(program->iSize, sizeof(INSTRUCTION));
+	program->dCode    = calloc(program->iSize + 1, sizeof(DECODED));
+	program->jitEntry = calloc(program->iSize + 1, sizeof(void*));
+	if ((program->iMem == NULL) || (program->dCode == NULL) || (program->jitEntry == NULL)) {
+		tmProgramFree(program);
+		return NULL;
+	}
+	decodeInstructions(program);
+	return program;
+} /* tmProgramNew */
+
+/********************************************/
+static void clearProgram(TMProgram* program) {
+	int i;
+	for (i = 0; i < program->symCount; i++) free(program->symTab[i].name);
+	for (i = 0; i < program->callCount; i++) free(program->callTab[i].name);
+	free(program->symTab);
+	free(program->callTab);
+	free(program->dataImage);
+	program->symTab    = NULL;
+	program->symCount  = 0;
+	program->callTab   = NULL;
+	program->callCount = 0;
+	program->dataImage = NULL;
+	program->dataCount = 0;
+	if (program->breakpoints != NULL) memset(program->breakpoints, 0, program->iSize);
+	program->breakCount = 0;
+	memset(program->iMem, 0, program->iSize * sizeof(INSTRUCTION)); /* HALT 0,0,0 */
+	freeJIT(program);
+} /* clearProgram */
+
+/********************************************/
+void tmProgramFree(TMProgram* program) {
+	if (program == NULL) return;
+	if (program->iMem != NULL) clearProgram(program);
+	free(program->iMem);
+	free(program->dCode);
+	free(program->jitEntry);
+	free(program->breakpoints);
+	free(program);
+} /* tmProgramFree */
+
+/********************************************/
+/* append name[0..length-1] at loc to a symbol table; FALSE if out of memory */
+static int addSymbol(SYMBOL** tab, int* count, int loc, const char* name, int length) {
+	SYMBOL* grown = realloc(*tab, (*count + 1) * sizeof(SYMBOL));
+	char*   copy  = malloc(length + 1);
+	if (grown != NULL) *tab = grown;
+	if ((grown == NULL) || (copy == NULL)) {
+		free(copy);
+		return FALSE;
+	}
+	memcpy(copy, name, length);
+	copy[length]       = '\0';
+	grown[*count].loc  = loc;
+	grown[*count].line = 0;
+	grown[*count].name = copy;
+	(*count)++;
+	return TRUE;
+} /* addSymbol */
+
+/********************************************/
+/* Length of the name in a code generator comment "* <marker> (name)", 0 if the comment line
+ * is something else; *name is set to its start.
+ */
+static int markerName(TMScanner* sc, const char* marker, const char** name) {
+	const char* text = sc->line + sc->inCol + 1;
+	const char* end  = sc->line + sc->lineLen;
+	const char* close;
+	int         markerLen = (int) strlen(marker);
+	while ((text < end) && (*text == ' ')) text++;
+	if ((end - text <= markerLen) || (strncmp(text, marker, markerLen) != 0)) return 0;
+	*name = text + markerLen;
+	close = memchr(*name, ')', end - *name);
+	return (close == NULL) ? 0 : (int) (close - *name);
+} /* markerName */
+
+/********************************************/
+int tmLoadText(TMProgram* program, const char* text, long length) {
+	TMScanner    sc;
+	INSTRUCTION* in;
+	const char*  end = text + length;
+	const char*  next;
+	const char*  funcName = NULL; /* pending code generator markers */
+	const char*  callName = NULL;
+	int          funcLen = 0, callLen = 0;
+	int          top     = -1; /* highest location loaded so far */
+	OPCODE       op;
+	int          arg1, arg2, arg3;
+	int          loc, lineNo;
+	clearProgram(program);
+	lineNo = 0;
+	for (; text < end; text = next) {
+		next = memchr(text, '\n', end - text);
+		next = (next == NULL) ? end : next + 1;
+		tmScanLine(&sc, text, (int) (next - text));
+		lineNo++;
+		if ((nonBlank(&sc)) && (sc.line[sc.inCol] == '*')) {
+			if (!funcLen) funcLen = markerName(&sc, "-> Init Function (", &funcName);
+			if (!callLen) callLen = markerName(&sc, "-> Function call (", &callName);
+		} else if (sc.inCol < sc.lineLen) {
+			if (!tmGetNum(&sc)) return error(program, "Bad location", lineNo, -1);
+			loc = sc.num;
+			if ((loc < 0) || (loc >= program->iSize))
+				return error(program, "Location too large", lineNo, loc);
+			if (!tmSkipCh(&sc, ':')) return error(program, "Missing colon", lineNo, loc);
+			if (!tmGetWord(&sc)) return error(program, "Missing opcode", lineNo, loc);
+			op = opHALT;
+			while ((op < opRALim) && (strncmp(tmOpCodeTab[op], sc.word, 4) != 0)) op++;
+			if (strncmp(tmOpCodeTab[op], sc.word, 4) != 0)
+				return error(program, "Illegal opcode", lineNo, loc);
+			switch (tmOpClass(op)) {
+				case opclRR:
+					/***********************************/
+					if ((!tmGetNum(&sc)) || (sc.num < 0) || (sc.num >= NO_REGS))
+						return error(program, "Bad first register", lineNo, loc);
+					arg1 = sc.num;
+					if (!tmSkipCh(&sc, ',')) return error(program, "Missing comma", lineNo, loc);
+					if ((!tmGetNum(&sc)) || (sc.num < 0) || (sc.num >= NO_REGS))
+						return error(program, "Bad second register", lineNo, loc);
+					arg2 = sc.num;
+					if (!tmSkipCh(&sc, ',')) return error(program, "Missing comma", lineNo, loc);
+					if ((!tmGetNum(&sc)) || (sc.num < 0) || (sc.num >= NO_REGS))
+						return error(program, "Bad third register", lineNo, loc);
+					arg3 = sc.num;
+					break;
+
+				case opclRM:
+				case opclRA:
+				default:
+					/***********************************/
+					if ((!tmGetNum(&sc)) || (sc.num < 0) || (sc.num >= NO_REGS))
+						return error(program, "Bad first register", lineNo, loc);
+					arg1 = sc.num;
+					if (!tmSkipCh(&sc, ',')) return error(program, "Missing comma", lineNo, loc);
+					if (!tmGetNum(&sc)) return error(program, "Bad displacement", lineNo, loc);
+					arg2 = sc.num;
+					if (!tmSkipCh(&sc, '(') && !tmSkipCh(&sc, ','))
+						return error(program, "Missing LParen", lineNo, loc);
+					if ((!tmGetNum(&sc)) || (sc.num < 0) || (sc.num >= NO_REGS))
+						return error(program, "Bad second register", lineNo, loc);
+					arg3 = sc.num;
+					break;
+			}
+			in        = &program->iMem[loc];
+			in->iop   = op;
+			in->iarg1 = arg1;
+			in->iarg2 = arg2;
+			in->iarg3 = arg3;
+			/* a marker belongs to the next instruction emitted after it, not to one the code
+			 * generator backpatched at a lower location
+			 */
+			if (loc > top) {
+				if (funcLen && !addSymbol(&program->symTab, &program->symCount, loc, funcName,
+				                          funcLen))
+					return error(program, "Out of memory", lineNo, loc);
+				if (callLen && !addSymbol(&program->callTab, &program->callCount, loc, callName,
+				                          callLen))
+					return error(program, "Out of memory", lineNo, loc);
+				funcLen = callLen = 0;
+				top               = loc;
+			}
+		}
+	}
+	decodeInstructions(program);
+	return TRUE;
+} /* tmLoadText */
+
+/********************************************/
+int tmLoadObject(TMProgram* program, const void* image, long size) {
+	const TmoHeader*      header = image;
+	const TmoInstruction* code;
+	const TmoSymbol*      symbols;
+	const TmoData*        data;
+	const char*           strings;
+	long                  expected;
+	int                   loc, i;
+	clearProgram(program);
+	if ((size < (long) sizeof(TmoHeader)) || (header->magic != TMO_MAGIC))
+		return error(program, "Not a TM object file", 0, -1);
+	if (header->version != TMO_VERSION) return error(program, "Unsupported object version", 0, -1);
+	if ((header->codeSize < 0) || (header->symbolCount < 0) || (header->stringSize < 0) ||
+	    (header->dataCount < 0))
+		return error(program, "Bad object header", 0, -1);
+	expected = sizeof(TmoHeader) + (long) header->codeSize * sizeof(TmoInstruction) +
+	           (long) header->symbolCount * sizeof(TmoSymbol) + header->stringSize +
+	           (long) header->dataCount * sizeof(TmoData);
+	if (expected != size) return error(program, "Object file size does not match header", 0, -1);
+	if (header->codeSize > program->iSize) return error(program, "Program too large", 0, -1);
+	code    = (const TmoInstruction*) (header + 1);
+	symbols = (const TmoSymbol*) (code + header->codeSize);
+	strings = (const char*) (symbols + header->symbolCount);
+	data    = (const TmoData*) (strings + header->stringSize);
+
+	for (loc = 0; loc < header->codeSize; loc++) {
+		if ((code[loc].op < 0) || (code[loc].op >= opRALim) || (code[loc].op == opRRLim) ||
+		    (code[loc].op == opRMLim))
+			return error(program, "Illegal opcode", 0, loc);
+		if ((code[loc].arg1 < 0) || (code[loc].arg1 >= NO_REGS) || (code[loc].arg3 < 0) ||
+		    (code[loc].arg3 >= NO_REGS))
+			return error(program, "Bad register", 0, loc);
+		if ((tmOpClass(code[loc].op) == opclRR) &&
+		    ((code[loc].arg2 < 0) || (code[loc].arg2 >= NO_REGS)))
+			return error(program, "Bad second register", 0, loc);
+		program->iMem[loc].iop   = code[loc].op;
+		program->iMem[loc].iarg1 = code[loc].arg1;
+		program->iMem[loc].iarg2 = code[loc].arg2;
+		program->iMem[loc].iarg3 = code[loc].arg3;
+	}
+	for (i = 0; i < header->dataCount; i++)
+		if (data[i].address < 0)
+			return error(program, "Data address out of range", 0, -1);
+	if ((header->stringSize > 0) && (strings[header->stringSize - 1] != '\0'))
+		return error(program, "Unterminated symbol name", 0, -1);
+	for (i = 0; i < header->symbolCount; i++)
+		if ((symbols[i].name < 0) || (symbols[i].name >= header->stringSize))
+			return error(program, "Bad symbol name", 0, -1);
+
+	program->dataImage = malloc(header->dataCount * sizeof(DATAWORD) + 1);
+	program->symTab    = malloc(header->symbolCount * sizeof(SYMBOL) + 1);
+	if ((program->dataImage == NULL) || (program->symTab == NULL))
+		return error(program, "Out of memory", 0, -1);
+	for (i = 0; i < header->dataCount; i++) {
+		program->dataImage[i].address = data[i].address;
+		program->dataImage[i].value   = data[i].value;
+	}
+	program->dataCount = header->dataCount;
+	for (i = 0; i < header->symbolCount; i++) {
+		program->symTab[i].loc  = symbols[i].loc;
+		program->symTab[i].line = symbols[i].line;
+		program->symTab[i].name = strdup(strings + symbols[i].name);
+		program->symCount++;
+	}
+	decodeInstructions(program);
+	return TRUE;
+} /* tmLoadObject */
+
+/********************************************/
+int tmLoadFile(TMProgram* program, const char* fileName) {
+	struct stat st;
+	void*       image;
+	int         fd, ok;
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		snprintf(program->error, sizeof(program->error), "file '%s' not found", fileName);
+		return FALSE;
+	}
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return error(program, "Cannot read file", 0, -1);
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return tmLoadText(program, "", 0);
+	}
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) return error(program, "Cannot map file", 0, -1);
+	if ((st.st_size >= (off_t) sizeof(unsigned int)) && (*(unsigned int*) image == TMO_MAGIC))
+		ok = tmLoadObject(program, image, st.st_size);
+	else
+		ok = tmLoadText(program, image, st.st_size);
+	munmap(image, st.st_size);
+	return ok;
+} /* tmLoadFile */
+
+/********************************************/
+const char* tmError(const TMProgram* program) {
+	return program->error;
+} /* tmError */
+
+/********************************************/
+int tmCodeSize(const TMProgram* program) {
+	return program->iSize;
+} /* tmCodeSize */
+
+/********************************************/
+const INSTRUCTION* tmInstruction(const TMProgram* program, int loc) {
+	return &program->iMem[loc];
+} /* tmInstruction */
+
+/********************************************/
+void tmWriteInstruction(const TMProgram* program, int loc, FILE* f) {
+	const INSTRUCTION* in = &program->iMem[loc];
+	fprintf(f, "%6s%3d,", tmOpCodeTab[in->iop], in->iarg1);
+	switch (tmOpClass(in->iop)) {
+		case opclRR:
+			fprintf(f, "%1d,%1d", in->iarg2, in->iarg3);
+			break;
+		case opclRM:
+		case opclRA:
+			fprintf(f, "%3d(%1d)", in->iarg2, in->iarg3);
+			break;
+	}
+} /* tmWriteInstruction */
+
+/********************************************/
+const char* tmSymbolAt(const TMProgram* program, int loc) {
+	int i;
+	for (i = 0; i < program->symCount; i++)
+		if (program->symTab[i].loc == loc) return program->symTab[i].name;
+	return NULL;
+} /* tmSymbolAt */
+
+/********************************************/
+/* index in symTab of the function containing loc: the closest entry point at or before it */
+int functionIndex(const TMProgram* program, int loc) {
+	int i, found = -1;
+	for (i = 0; i < program->symCount; i++)
+		if ((program->symTab[i].loc <= loc) &&
+		    ((found < 0) || (program->symTab[i].loc > program->symTab[found].loc)))
+			found = i;
+	return found;
+} /* functionIndex */
+
+/********************************************/
+const char* tmFunctionAt(const TMProgram* program, int loc) {
+	int i = functionIndex(program, loc);
+	return (i < 0) ? NULL : program->symTab[i].name;
+} /* tmFunctionAt */
+
+/********************************************/
+/* Mark the code generator idioms that start at each location with a superinstruction that
+ * runs them in one dispatch. Only the first location of a sequence changes, the others keep
+ * their own handlers, so a jump into the middle of a sequence still executes it one
+ * instruction at a time.
+ */
+static int fusable(const TMProgram* program, int loc, int length) {
+	return loc + length <= program->iSize;
+} /* fusable */
+
+static void fuseInstructions(TMProgram* program) {
+	DECODED* ip;
+	int      loc;
+	for (loc = 0; loc < program->iSize; loc++) {
+		ip = &program->dCode[loc];
+		if ((ip->kind == hSUB) && fusable(program, loc, 5) && (ip[1].kind >= hJLT) &&
+		    (ip[1].kind <= hJNE) && (ip[1].r == ip->r) && (ip[1].s == ZERO_REG) &&
+		    (ip[1].d == loc + 4) && (ip[2].kind == hLDC) && (ip[2].r == ip->r) &&
+		    (ip[2].d == 0) && (ip[3].kind == hJMP) && (ip[3].s == ZERO_REG) &&
+		    (ip[3].d == loc + 5) && (ip[4].kind == hLDC) && (ip[4].r == ip->r) && (ip[4].d == 1))
+			ip->fused = hRELLT + (ip[1].kind - hJLT);
+		else if ((ip->kind == hLD) && fusable(program, loc, 2) && (ip[1].kind >= hADD) &&
+		         (ip[1].kind <= hDIV))
+			ip->fused = hLDADD + (ip[1].kind - hADD);
+		else if ((ip->kind == hST) && fusable(program, loc, 2) && (ip[1].kind == hLD))
+			ip->fused = hSTLD;
+		else if ((ip->kind == hST) && fusable(program, loc, 2) && (ip[1].kind == hLDC))
+			ip->fused = hSTLDC;
+		else if ((ip->kind == hLDC) && fusable(program, loc, 4) && (ip[1].kind == hADD) &&
+		         (ip[2].kind == hSUB) && ((ip[3].kind == hLD) || (ip[3].kind == hST)))
+			ip->fused = (ip[3].kind == hLD) ? hIDXLD : hIDXST;
+	}
+} /* fuseInstructions */
+
+/* number of instructions a superinstruction executes without a dispatch */
+int fusedLength(int fused) {
+	if ((fused >= hRELLT) && (fused <= hRELNE)) return 5;
+	if ((fused == hIDXLD) || (fused == hIDXST)) return 4;
+	return (fused == hSTEP) ? 1 : 2;
+} /* fusedLength */
+
+/********************************************/
+/* Prove what the threaded engine need not check at run time. Every location but the last falls
+ * through into iMem and the last into the faulting entry at iSize, so only jumps remain: a jump
+ * to a constant location in iMem is verified, one to a register or an outside constant is
+ * checked when it is taken. Data memory addresses are left to the engines, since the size of
+ * dMem belongs to the context.
+ */
+static void verifyInstructions(TMProgram* program) {
+	DECODED* ip;
+	int      loc;
+	for (loc = 0; loc < program->iSize; loc++) {
+		ip           = &program->dCode[loc];
+		ip->verified = (ip->kind >= hJMP) && (ip->kind <= hJNE) && (ip->s == ZERO_REG) &&
+		               (ip->d >= 0) && (ip->d < program->iSize);
+	}
+} /* verifyInstructions */
+
+/********************************************/
+void decodeInstructions(TMProgram* program) {
+	INSTRUCTION* in;
+	DECODED*     out;
+	int          loc;
+	for (loc = 0; loc < program->iSize; loc++) {
+		in         = &program->iMem[loc];
+		out        = &program->dCode[loc];
+		out->kind  = hSTEP;
+		out->fused = hSTEP;
+		out->r     = in->iarg1;
+		out->s     = in->iarg2;
+		out->t     = in->iarg3;
+		out->d     = 0;
+		switch (tmOpClass(in->iop)) {
+			case opclRR:
+				/***********************************/
+				if ((out->r == PC_REG) || (out->s == PC_REG) || (out->t == PC_REG)) break;
+				if ((in->iop >= opADD) && (in->iop <= opDIV)) out->kind = hADD + (in->iop - opADD);
+				break;
+
+			case opclRM:
+			case opclRA:
+				/***********************************/
+				out->s = in->iarg3;
+				out->d = in->iarg2;
+				if (out->s == PC_REG) {
+					out->s = ZERO_REG;
+					out->d += loc + 1;
+				}
+				if (in->iop == opLDC) {
+					out->s = ZERO_REG;
+					out->d = in->iarg2;
+				}
+				if (out->r == PC_REG) {
+					if (in->iop == opLD)
+						out->kind = hLDPC;
+					else if ((in->iop == opLDA) || (in->iop == opLDC))
+						out->kind = hJMP;
+				} else if (in->iop == opLD)
+					out->kind = hLD;
+				else if (in->iop == opST)
+					out->kind = hST;
+				else if (in->iop == opLDA)
+					out->kind = hLDA;
+				else if (in->iop == opLDC)
+					out->kind = hLDC;
+				else
+					out->kind = hJLT + (in->iop - opJLT);
+				break;
+		}
+	}
+	verifyInstructions(program);
+	fuseInstructions(program);
+	runThreaded(NULL, 0, program);
+} /* decodeInstructions */
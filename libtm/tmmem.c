@@ -0,0 +1,200 @@
+/****************************************************/
+/* File: tmmem.c                                    */
+/* Data memory access profiles and cache simulation */
+/* of TM programs                                   */
+/****************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmint.h"
+
+#define MEMPROFILE_ARRAYS 20 /* arrays with the most accesses reported */
+
+/* accesses of a function or array in a memory profile report */
+typedef struct {
+	int  key;    /* index in symTab, symCount for code outside functions, or base address */
+	long hits;
+	long misses;
+} ACCESSES;
+
+/********************************************/
+TMMemProfile* tmMemProfileNew(const TMProgram* program, int dSize, int sets, int ways,
+                              int lineWords) {
+	TMMemProfile* profile;
+	if ((sets <= 0) || (ways <= 0) || (lineWords <= 0)) return NULL;
+	profile = calloc(1, sizeof(TMMemProfile));
+	if (profile == NULL) return NULL;
+	profile->dSize       = (dSize > 0) ? dSize : DADDR_SIZE;
+	profile->iSize       = program->iSize;
+	profile->sets        = sets;
+	profile->ways        = ways;
+	profile->lineWords   = lineWords;
+	profile->reads       = calloc(profile->dSize, sizeof(long));
+	profile->writes      = calloc(profile->dSize, sizeof(long));
+	profile->misses      = calloc(profile->dSize, sizeof(long));
+	profile->arrayHits   = calloc(profile->dSize, sizeof(long));
+	profile->arrayMisses = calloc(profile->dSize, sizeof(long));
+	profile->arrayLow    = malloc(profile->dSize * sizeof(int));
+	profile->locHits     = calloc(program->iSize, sizeof(long));
+	profile->locMisses   = calloc(program->iSize, sizeof(long));
+	profile->lines       = malloc((size_t) sets * ways * sizeof(int));
+	if ((profile->reads == NULL) || (profile->writes == NULL) || (profile->misses == NULL) ||
+	    (profile->arrayHits == NULL) || (profile->arrayMisses == NULL) ||
+	    (profile->arrayLow == NULL) || (profile->locHits == NULL) ||
+	    (profile->locMisses == NULL) || (profile->lines == NULL)) {
+		tmMemProfileFree(profile);
+		return NULL;
+	}
+	memset(profile->lines, -1, (size_t) sets * ways * sizeof(int));
+	return profile;
+} /* tmMemProfileNew */
+
+/********************************************/
+void tmMemProfileFree(TMMemProfile* profile) {
+	if (profile == NULL) return;
+	free(profile->reads);
+	free(profile->writes);
+	free(profile->misses);
+	free(profile->arrayHits);
+	free(profile->arrayMisses);
+	free(profile->arrayLow);
+	free(profile->locHits);
+	free(profile->locMisses);
+	free(profile->lines);
+	free(profile);
+} /* tmMemProfileFree */
+
+/* whether the line of address is cached, making it the most recently used line of its set */
+static int cacheAccess(TMMemProfile* profile, int address) {
+	int  line = address / profile->lineWords;
+	int* set  = &profile->lines[(line % profile->sets) * profile->ways];
+	int  way, hit;
+	for (way = 0; (way < profile->ways - 1) && (set[way] != line); way++)
+		;
+	hit = (set[way] == line); /* otherwise the least recently used line is replaced */
+	memmove(&set[1], &set[0], way * sizeof(int));
+	set[0] = line;
+	return hit;
+} /* cacheAccess */
+
+/********************************************/
+/* Count the LD or ST at pc, of address, before it executes. An access through a register just
+ * computed by SUB a,a,b with no displacement is an array element, as the code generator
+ * indexes arrays downwards from their base: the base is reg[a] + reg[b].
+ */
+void memAccess(TMMemProfile* profile, const TMContext* context, int pc, int address) {
+	const INSTRUCTION* in = &context->program->iMem[pc];
+	const INSTRUCTION* prev;
+	int                hit, base;
+	if ((address >= profile->dSize) || (pc >= profile->iSize)) return;
+	if (in->iop == opST)
+		profile->writes[address]++;
+	else
+		profile->reads[address]++;
+	hit = cacheAccess(profile, address);
+	if (hit)
+		profile->locHits[pc]++;
+	else {
+		profile->locMisses[pc]++;
+		profile->misses[address]++;
+	}
+	if ((pc == 0) || (in->iarg2 != 0)) return;
+	prev = in - 1;
+	if ((prev->iop != opSUB) || (prev->iarg1 != in->iarg3) || (prev->iarg2 != in->iarg3)) return;
+	base = context->reg[prev->iarg1] + context->reg[prev->iarg3];
+	if ((base <= address) || (base >= profile->dSize)) return;
+	if ((profile->arrayHits[base] == 0) && (profile->arrayMisses[base] == 0))
+		profile->arrayLow[base] = address;
+	else if (address < profile->arrayLow[base])
+		profile->arrayLow[base] = address;
+	if (hit)
+		profile->arrayHits[base]++;
+	else
+		profile->arrayMisses[base]++;
+} /* memAccess */
+
+static int byAccesses(const void* a, const void* b) {
+	const ACCESSES* x = a;
+	const ACCESSES* y = b;
+	long            n = x->hits + x->misses;
+	long            m = y->hits + y->misses;
+	if (n != m) return (n < m) ? 1 : -1;
+	return x->key - y->key;
+} /* byAccesses */
+
+static double hitRate(long hits, long misses) {
+	return (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0;
+} /* hitRate */
+
+/********************************************/
+int tmWriteMemProfile(const TMProgram* program, const TMMemProfile* profile, FILE* f) {
+	ACCESSES* tab;
+	long      reads = 0, writes = 0, hits = 0, misses = 0;
+	int       size  = (profile->iSize < program->iSize) ? profile->iSize : program->iSize;
+	int       n, i, loc, a;
+
+	n   = (program->symCount + 1 > profile->dSize) ? program->symCount + 1 : profile->dSize;
+	tab = malloc(n * sizeof(ACCESSES));
+	if (tab == NULL) return FALSE;
+	for (a = 0; a < profile->dSize; a++) {
+		reads += profile->reads[a];
+		writes += profile->writes[a];
+	}
+	for (loc = 0; loc < size; loc++) {
+		hits += profile->locHits[loc];
+		misses += profile->locMisses[loc];
+	}
+	fprintf(f, "Memory profile: %ld reads, %ld writes\n", reads, writes);
+	fprintf(f, "Cache: %d sets, %d ways, %d words per line: %ld hits, %ld misses, %.2f%% hits\n",
+	        profile->sets, profile->ways, profile->lineWords, hits, misses, hitRate(hits, misses));
+
+	/* functions, plus the code outside of them as the last entry */
+	if (program->symCount > 0) {
+		for (i = 0; i <= program->symCount; i++) {
+			tab[i].key    = i;
+			tab[i].hits   = 0;
+			tab[i].misses = 0;
+		}
+		for (loc = 0; loc < size; loc++) {
+			i = functionIndex(program, loc);
+			if (i < 0) i = program->symCount;
+			tab[i].hits += profile->locHits[loc];
+			tab[i].misses += profile->locMisses[loc];
+		}
+		qsort(tab, program->symCount + 1, sizeof(ACCESSES), byAccesses);
+		fprintf(f, "\nFunctions:\n%12s %12s %12s %7s  %s\n", "accesses", "hits", "misses", "hits",
+		        "function");
+		for (i = 0; (i <= program->symCount) && (tab[i].hits + tab[i].misses > 0); i++)
+			fprintf(f, "%12ld %12ld %12ld %6.2f%%  %s\n", tab[i].hits + tab[i].misses,
+			        tab[i].hits, tab[i].misses, hitRate(tab[i].hits, tab[i].misses),
+			        (tab[i].key < program->symCount) ? program->symTab[tab[i].key].name
+			                                         : "(outside functions)");
+	}
+
+	/* arrays, by base address; their elements lie below it */
+	n = 0;
+	for (a = 0; a < profile->dSize; a++) {
+		if (profile->arrayHits[a] + profile->arrayMisses[a] == 0) continue;
+		tab[n].key    = a;
+		tab[n].hits   = profile->arrayHits[a];
+		tab[n].misses = profile->arrayMisses[a];
+		n++;
+	}
+	qsort(tab, n, sizeof(ACCESSES), byAccesses);
+	fprintf(f, "\nArrays:\n%7s %13s %12s %12s %12s %7s\n", "base", "elements", "accesses", "hits",
+	        "misses", "hits");
+	for (i = 0; (i < n) && (i < MEMPROFILE_ARRAYS); i++)
+		fprintf(f, "%7d %6d-%-6d %12ld %12ld %12ld %6.2f%%\n", tab[i].key,
+		        profile->arrayLow[tab[i].key], tab[i].key - 1, tab[i].hits + tab[i].misses,
+		        tab[i].hits, tab[i].misses, hitRate(tab[i].hits, tab[i].misses));
+
+	/* every address accessed, in address order */
+	fprintf(f, "\nAddresses:\n%7s %12s %12s %12s\n", "address", "reads", "writes", "misses");
+	for (a = 0; a < profile->dSize; a++)
+		if (profile->reads[a] + profile->writes[a] > 0)
+			fprintf(f, "%7d %12ld %12ld %12ld\n", a, profile->reads[a], profile->writes[a],
+			        profile->misses[a]);
+	free(tab);
+	return !ferror(f);
+} /* tmWriteMemProfile */
@@ -0,0 +1,219 @@
+/****************************************************/
+/* File: tmprof.c                                   */
+/* Execution profiles of TM programs                */
+/****************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmint.h"
+
+#define PROFILE_BLOCKS 20 /* hottest basic blocks reported */
+#define PROFILE_LOOPS 10  /* hottest loops reported */
+
+/* a function, basic block or loop of a profile report */
+typedef struct {
+	int  first, last;  /* locations */
+	long entries;      /* calls, block executions or loop iterations */
+	long instructions; /* instructions executed in it */
+	long cycles;       /* estimated by the cost model */
+	int  function;     /* index in symTab of the function containing it, or -1 */
+} RANGE;
+
+/********************************************/
+TMProfile* tmProfileNew(const TMProgram* program) {
+	TMProfile* profile = calloc(1, sizeof(TMProfile));
+	if (profile == NULL) return NULL;
+	profile->size  = program->iSize;
+	profile->count = calloc(program->iSize, sizeof(long));
+	profile->taken = calloc(program->iSize, sizeof(long));
+	if ((profile->count == NULL) || (profile->taken == NULL)) {
+		tmProfileFree(profile);
+		return NULL;
+	}
+	return profile;
+} /* tmProfileNew */
+
+/********************************************/
+void tmProfileFree(TMProfile* profile) {
+	if (profile == NULL) return;
+	free(profile->count);
+	free(profile->taken);
+	free(profile);
+} /* tmProfileFree */
+
+/********************************************/
+/* Report of a profile. Basic blocks start at location 0, at function entry points, at constant
+ * jump targets and after every instruction that may jump; the targets of computed jumps (the
+ * return addresses of calls) follow a jump anyway. A loop is a backward constant jump within a
+ * function whose target is not a function entry point, which would make it a call.
+ */
+
+/* whether the instruction may transfer control anywhere but to the next location */
+static int endsBlock(const INSTRUCTION* in) {
+	if ((in->iop == opHALT) || (in->iop >= opJLT)) return TRUE;
+	return (in->iarg1 == PC_REG) && (in->iop != opOUT) && (in->iop != opST);
+} /* endsBlock */
+
+/* constant target of the jump at loc, or -1 */
+static int jumpTarget(const TMProgram* program, int loc) {
+	const DECODED* ip = &program->dCode[loc];
+	if (((ip->kind == hJMP) || ((ip->kind >= hJLT) && (ip->kind <= hJNE))) &&
+	    (ip->s == ZERO_REG) && (ip->d >= 0) && (ip->d < program->iSize))
+		return ip->d;
+	return -1;
+} /* jumpTarget */
+
+static long rangeCount(const TMProfile* profile, int first, int last) {
+	long sum = 0;
+	while (first <= last) sum += profile->count[first++];
+	return sum;
+} /* rangeCount */
+
+static int byInstructions(const void* a, const void* b) {
+	const RANGE* x = a;
+	const RANGE* y = b;
+	if (x->instructions != y->instructions) return (x->instructions < y->instructions) ? 1 : -1;
+	return x->first - y->first;
+} /* byInstructions */
+
+static const char* functionName(const TMProgram* program, int function) {
+	return (function < 0) ? "-" : program->symTab[function].name;
+} /* functionName */
+
+static double percent(long part, long total) {
+	return (total > 0) ? 100.0 * part / total : 0.0;
+} /* percent */
+
+/********************************************/
+int tmWriteProfile(const TMProgram* program, const TMProfile* profile, const TMCostModel* model,
+                   FILE* f) {
+	const INSTRUCTION* in;
+	RANGE*             range;
+	char*              leader;
+	long               total = 0;
+	int                size  = (profile->size < program->iSize) ? profile->size : program->iSize;
+	int                n, loc, first, target, i;
+
+	range  = malloc((size + program->symCount + 1) * sizeof(RANGE));
+	leader = calloc(size + 1, 1);
+	if ((range == NULL) || (leader == NULL)) {
+		free(range);
+		free(leader);
+		return FALSE;
+	}
+	for (loc = 0; loc < size; loc++) total += profile->count[loc];
+	fprintf(f, "Profile: %ld instructions executed", total);
+	if (model != NULL) fprintf(f, ", %ld estimated cycles", tmCycles(program, profile, model));
+	fprintf(f, "\n");
+
+	/* functions, plus the code outside of them as the last range */
+	if (program->symCount > 0) {
+		for (i = 0; i <= program->symCount; i++) {
+			range[i].first        = (i < program->symCount) ? program->symTab[i].loc : 0;
+			range[i].entries      = ((i < program->symCount) && (range[i].first < size))
+			                            ? profile->count[range[i].first]
+			                            : 0;
+			range[i].instructions = 0;
+			range[i].cycles       = 0;
+			range[i].function     = (i < program->symCount) ? i : -1;
+		}
+		for (loc = 0; loc < size; loc++) {
+			i = functionIndex(program, loc);
+			if (i < 0) i = program->symCount;
+			range[i].instructions += profile->count[loc];
+			if (model != NULL) range[i].cycles += tmLocationCycles(program, profile, model, loc);
+		}
+		qsort(range, program->symCount + 1, sizeof(RANGE), byInstructions);
+		fprintf(f, "\nFunctions:\n%14s %7s", "instructions", "%");
+		if (model != NULL) fprintf(f, " %14s", "cycles");
+		fprintf(f, " %10s  %s\n", "calls", "function");
+		for (i = 0; (i <= program->symCount) && (range[i].instructions > 0); i++) {
+			fprintf(f, "%14ld %6.2f%%", range[i].instructions,
+			        percent(range[i].instructions, total));
+			if (model != NULL) fprintf(f, " %14ld", range[i].cycles);
+			if (range[i].function >= 0)
+				fprintf(f, " %10ld  %s\n", range[i].entries,
+				        functionName(program, range[i].function));
+			else
+				fprintf(f, " %10s  (outside functions)\n", "-");
+		}
+	}
+
+	/* basic blocks */
+	leader[0] = TRUE;
+	for (i = 0; i < program->symCount; i++)
+		if ((program->symTab[i].loc >= 0) && (program->symTab[i].loc < size))
+			leader[program->symTab[i].loc] = TRUE;
+	for (loc = 0; loc < size; loc++) {
+		if (endsBlock(&program->iMem[loc])) leader[loc + 1] = TRUE;
+		target = jumpTarget(program, loc);
+		if ((target >= 0) && (target < size)) leader[target] = TRUE;
+	}
+	n = 0;
+	for (first = 0; first < size; first = loc + 1) {
+		for (loc = first; (loc + 1 < size) && !leader[loc + 1]; loc++);
+		range[n].first        = first;
+		range[n].last         = loc;
+		range[n].entries      = profile->count[first];
+		range[n].instructions = rangeCount(profile, first, loc);
+		range[n].function     = functionIndex(program, first);
+		if (range[n].instructions > 0) n++;
+	}
+	qsort(range, n, sizeof(RANGE), byInstructions);
+	fprintf(f, "\nHottest basic blocks:\n%11s %12s %14s %7s  %s\n", "locations", "executions",
+	        "instructions", "%", "function");
+	for (i = 0; (i < n) && (i < PROFILE_BLOCKS); i++)
+		fprintf(f, "%5d-%-5d %12ld %14ld %6.2f%%  %s\n", range[i].first, range[i].last,
+		        range[i].entries, range[i].instructions, percent(range[i].instructions, total),
+		        functionName(program, range[i].function));
+
+	/* loops */
+	n = 0;
+	for (loc = 0; loc < size; loc++) {
+		target = jumpTarget(program, loc);
+		if ((target < 0) || (target > loc) || (tmSymbolAt(program, target) != NULL) ||
+		    (functionIndex(program, target) != functionIndex(program, loc)))
+			continue;
+		range[n].first        = target;
+		range[n].last         = loc;
+		range[n].entries      = (program->iMem[loc].iop >= opJLT) ? profile->taken[loc]
+		                                                          : profile->count[loc];
+		range[n].instructions = rangeCount(profile, target, loc);
+		range[n].function     = functionIndex(program, loc);
+		if (range[n].entries > 0) n++;
+	}
+	qsort(range, n, sizeof(RANGE), byInstructions);
+	fprintf(f, "\nHottest loops:\n%11s %12s %14s %7s  %s\n", "locations", "iterations",
+	        "instructions", "%", "function");
+	for (i = 0; (i < n) && (i < PROFILE_LOOPS); i++)
+		fprintf(f, "%5d-%-5d %12ld %14ld %6.2f%%  %s\n", range[i].first, range[i].last,
+		        range[i].entries, range[i].instructions, percent(range[i].instructions, total),
+		        functionName(program, range[i].function));
+
+	/* conditional jumps */
+	fprintf(f, "\nConditional jumps:\n%8s %12s %12s %12s %7s  %s\n", "location", "executions",
+	        "taken", "not taken", "taken", "function");
+	for (loc = 0; loc < size; loc++) {
+		in = &program->iMem[loc];
+		if ((in->iop < opJLT) || (in->iop >= opRALim) || (profile->count[loc] == 0)) continue;
+		fprintf(f, "%8d %12ld %12ld %12ld %6.2f%%  %s\n", loc, profile->count[loc],
+		        profile->taken[loc], profile->count[loc] - profile->taken[loc],
+		        percent(profile->taken[loc], profile->count[loc]),
+		        functionName(program, functionIndex(program, loc)));
+	}
+
+	/* call sites, from the code generator's comments */
+	if (program->callCount > 0) {
+		fprintf(f, "\nCall sites:\n%8s %12s  %s\n", "location", "calls", "caller -> callee");
+		for (i = 0; i < program->callCount; i++) {
+			loc = program->callTab[i].loc;
+			if ((loc < 0) || (loc >= size) || (profile->count[loc] == 0)) continue;
+			fprintf(f, "%8d %12ld  %s -> %s\n", loc, profile->count[loc],
+			        functionName(program, functionIndex(program, loc)), program->callTab[i].name);
+		}
+	}
+	free(range);
+	free(leader);
+	return !ferror(f);
+} /* tmWriteProfile */
@@ -0,0 +1,432 @@
+/****************************************************/
+/* File: tmrec.c                                    */
+/* Record and replay of TM executions               */
+/****************************************************/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "tmint.h"
+#include "tmreplay.h"
+
+#define CHECKPOINT_INTERVAL (1L << 20) /* default instructions between two checkpoints */
+
+/* The callbacks of the context and its user are saved in the recorder or replay, which takes
+ * their place, and called from there.
+ */
+struct TMRecorder {
+	TMContext* context;
+	FILE*      file;
+	long       interval;
+	TMInput    input;
+	TMOutput   output;
+	TMHalt     halt;
+	void*      user;
+	long       inputs; /* IN values recorded */
+	int*       shadow; /* data memory at the last checkpoint */
+	int        error;  /* a write to file failed */
+};
+
+/* a checkpoint of a replay log */
+typedef struct {
+	long steps;
+	long inputs;
+	long offset; /* of its TmrRecord in the file */
+} CHECKPOINT;
+
+/* the checkpoints that wrote a page of data memory, in order */
+typedef struct {
+	int*  checkpoints;
+	long* offsets; /* of the words of the page in the file */
+	int   count;
+	int   size;
+} PAGEINDEX;
+
+struct TMReplay {
+	TMContext*  context;
+	FILE*       file;
+	TMInput     input;
+	TMOutput    output;
+	TMHalt      halt;
+	void*       user;
+	int*        values; /* every IN value of the log */
+	long        valueCount;
+	long        pos;    /* next value consumed */
+	CHECKPOINT* checkpoints;
+	int         checkpointCount;
+	PAGEINDEX*  pages; /* by page number */
+	long        endSteps; /* of the TMR_END record, or -1 if the log was cut short */
+	int         endResult;
+};
+
+/* FNV-1a hash of the instruction memory, telling whether a log was recorded from a program */
+static uint32_t programHash(const TMProgram* program) {
+	uint32_t h = 2166136261u;
+	int      loc;
+	for (loc = 0; loc < program->iSize; loc++) {
+		h = (h ^ (uint32_t) program->iMem[loc].iop) * 16777619u;
+		h = (h ^ (uint32_t) program->iMem[loc].iarg1) * 16777619u;
+		h = (h ^ (uint32_t) program->iMem[loc].iarg2) * 16777619u;
+		h = (h ^ (uint32_t) program->iMem[loc].iarg3) * 16777619u;
+	}
+	return h;
+} /* programHash */
+
+/******** recording ********/
+
+static int recordInput(void* user, int* value) {
+	TMRecorder* recorder = user;
+	TmrRecord   record;
+	if (!recorder->input(recorder->user, value)) return FALSE;
+	record.kind       = TMR_INPUT;
+	record.value      = *value;
+	if (fwrite(&record, sizeof(record), 1, recorder->file) != 1) recorder->error = TRUE;
+	recorder->inputs++;
+	return TRUE;
+} /* recordInput */
+
+static void recordOutput(void* user, int value) {
+	TMRecorder* recorder = user;
+	if (recorder->output != NULL) recorder->output(recorder->user, value);
+} /* recordOutput */
+
+static void recordHalt(void* user, int r, int s, int t) {
+	TMRecorder* recorder = user;
+	if (recorder->halt != NULL) recorder->halt(recorder->user, r, s, t);
+} /* recordHalt */
+
+/* a checkpoint of the pages that differ from the shadow copy, which then equals dMem */
+static void writeCheckpoint(TMRecorder* recorder) {
+	TMContext*    context = recorder->context;
+	TmrRecord     record;
+	TmrCheckpoint checkpoint;
+	int           p, words, changed = 0;
+	int*          page;
+	int*          copy;
+	for (p = 0; p < DPAGES(context->dSize); p++) {
+		if (!(context->pages[p] & DPAGE_WRITTEN)) continue;
+		words = pageWords(context->dSize, p);
+		if (memcmp(context->dMem + ((size_t) p << DPAGE_SHIFT),
+		           recorder->shadow + ((size_t) p << DPAGE_SHIFT), words * sizeof(int)) != 0)
+			changed++;
+	}
+	record.kind           = TMR_CHECKPOINT;
+	record.value          = changed;
+	checkpoint.steps  = context->steps;
+	checkpoint.inputs = recorder->inputs;
+	for (p = 0; p < 3; p++) checkpoint.classCount[p] = context->classCount[p];
+	for (p = 0; p < NO_REGS; p++) checkpoint.reg[p] = context->reg[p];
+	if ((fwrite(&record, sizeof(record), 1, recorder->file) != 1) ||
+	    (fwrite(&checkpoint, sizeof(checkpoint), 1, recorder->file) != 1))
+		recorder->error = TRUE;
+	for (p = 0; (p < DPAGES(context->dSize)) && (changed > 0); p++) {
+		if (!(context->pages[p] & DPAGE_WRITTEN)) continue;
+		words = pageWords(context->dSize, p);
+		page  = context->dMem + ((size_t) p << DPAGE_SHIFT);
+		copy  = recorder->shadow + ((size_t) p << DPAGE_SHIFT);
+		if (memcmp(page, copy, words * sizeof(int)) == 0) continue;
+		if ((fwrite(&p, sizeof(int), 1, recorder->file) != 1) ||
+		    (fwrite(page, sizeof(int), words, recorder->file) != (size_t) words))
+			recorder->error = TRUE;
+		memcpy(copy, page, words * sizeof(int));
+		changed--;
+	}
+} /* writeCheckpoint */
+
+/********************************************/
+TMRecorder* tmRecordNew(TMContext* context, FILE* file, long interval) {
+	TMRecorder* recorder = calloc(1, sizeof(TMRecorder));
+	TmrHeader   header;
+	if (recorder == NULL) return NULL;
+	recorder->shadow = mapMemory(context->dSize);
+	if (recorder->shadow == NULL) {
+		free(recorder);
+		return NULL;
+	}
+	recorder->context  = context;
+	recorder->file     = file;
+	recorder->interval = (interval > 0) ? interval : CHECKPOINT_INTERVAL;
+	recorder->input    = context->input;
+	recorder->output   = context->output;
+	recorder->halt     = context->halt;
+	recorder->user     = context->user;
+	context->input     = recordInput;
+	context->output    = recordOutput;
+	context->halt      = recordHalt;
+	context->user      = recorder;
+	header.magic       = TMR_MAGIC;
+	header.version     = TMR_VERSION;
+	header.program     = programHash(context->program);
+	header.dSize       = context->dSize;
+	header.interval    = recorder->interval;
+	if (fwrite(&header, sizeof(header), 1, file) != 1) recorder->error = TRUE;
+	writeCheckpoint(recorder);
+	return recorder;
+} /* tmRecordNew */
+
+/********************************************/
+/* The run is cut into tmRun calls of at most interval instructions, with a checkpoint after
+ * each; a time limit is shared out among them.
+ */
+STEPRESULT tmRecordRun(TMRecorder* recorder, long budget) {
+	TMContext* context   = recorder->context;
+	long       timeLimit = context->timeLimit;
+	long       start     = (timeLimit > 0) ? clockMillis() : 0;
+	long       stop, next;
+	STEPRESULT stepResult;
+	stop = ((budget > 0) && (context->steps <= LONG_MAX - budget)) ? context->steps + budget
+	                                                               : LONG_MAX;
+	for (;;) {
+		next = (context->steps / recorder->interval + 1) * recorder->interval;
+		if (next > stop) next = stop;
+		if (timeLimit > 0) {
+			context->timeLimit = timeLimit - (clockMillis() - start);
+			if (context->timeLimit <= 0) {
+				stepResult = srTIMEOUT;
+				break;
+			}
+		}
+		stepResult = tmRun(context, next - context->steps);
+		if ((stepResult != srBUDGET) || (context->steps >= stop)) break;
+		writeCheckpoint(recorder);
+	}
+	context->timeLimit = timeLimit;
+	return stepResult;
+} /* tmRecordRun */
+
+/********************************************/
+int tmRecordEnd(TMRecorder* recorder, STEPRESULT result) {
+	TMContext* context = recorder->context;
+	TmrRecord  record;
+	int64_t    steps = context->steps;
+	int        ok;
+	record.kind  = TMR_END;
+	record.value = result;
+	if ((fwrite(&record, sizeof(record), 1, recorder->file) != 1) ||
+	    (fwrite(&steps, sizeof(steps), 1, recorder->file) != 1) || (fflush(recorder->file) != 0))
+		recorder->error = TRUE;
+	context->input  = recorder->input;
+	context->output = recorder->output;
+	context->halt   = recorder->halt;
+	context->user   = recorder->user;
+	ok              = !recorder->error;
+	munmap(recorder->shadow, (size_t) context->dSize * sizeof(int));
+	free(recorder);
+	return ok;
+} /* tmRecordEnd */
+
+/******** replay ********/
+
+static int replayInput(void* user, int* value) {
+	TMReplay* replay = user;
+	if (replay->pos >= replay->valueCount) return FALSE;
+	*value = replay->values[replay->pos++];
+	return TRUE;
+} /* replayInput */
+
+static void replayOutput(void* user, int value) {
+	TMReplay* replay = user;
+	if (replay->output != NULL) replay->output(replay->user, value);
+} /* replayOutput */
+
+static void replayHalt(void* user, int r, int s, int t) {
+	TMReplay* replay = user;
+	if (replay->halt != NULL) replay->halt(replay->user, r, s, t);
+} /* replayHalt */
+
+/* add a version of page p, written by the last checkpoint read, to the index */
+static int indexPage(TMReplay* replay, int p, long offset) {
+	PAGEINDEX* index = &replay->pages[p];
+	int*       checkpoints;
+	long*      offsets;
+	if (index->count == index->size) {
+		index->size = index->size ? 2 * index->size : 4;
+		checkpoints = realloc(index->checkpoints, index->size * sizeof(int));
+		if (checkpoints == NULL) return FALSE;
+		index->checkpoints = checkpoints;
+		offsets            = realloc(index->offsets, index->size * sizeof(long));
+		if (offsets == NULL) return FALSE;
+		index->offsets = offsets;
+	}
+	index->checkpoints[index->count] = replay->checkpointCount - 1;
+	index->offsets[index->count]     = offset;
+	index->count++;
+	return TRUE;
+} /* indexPage */
+
+/* index the records of the log: every IN value, where each checkpoint is and which pages it
+ * wrote */
+static int readLog(TMReplay* replay) {
+	TmrRecord     record;
+	TmrCheckpoint checkpoint;
+	CHECKPOINT*   checkpoints;
+	int*          values;
+	int64_t       steps;
+	long          offset, size = 0, valueSize = 0;
+	int           p, words, dSize = replay->context->dSize;
+	replay->pages = calloc(DPAGES(dSize), sizeof(PAGEINDEX));
+	if (replay->pages == NULL) return FALSE;
+	while (offset = ftell(replay->file), fread(&record, sizeof(record), 1, replay->file) == 1) {
+		switch (record.kind) {
+			case TMR_INPUT:
+				if (replay->valueCount == valueSize) {
+					valueSize = valueSize ? 2 * valueSize : 1024;
+					values    = realloc(replay->values, valueSize * sizeof(int));
+					if (values == NULL) return FALSE;
+					replay->values = values;
+				}
+				replay->values[replay->valueCount++] = record.value;
+				break;
+
+			case TMR_CHECKPOINT:
+				if (fread(&checkpoint, sizeof(checkpoint), 1, replay->file) != 1) return FALSE;
+				if (replay->checkpointCount == size) {
+					size        = size ? 2 * size : 64;
+					checkpoints = realloc(replay->checkpoints, size * sizeof(CHECKPOINT));
+					if (checkpoints == NULL) return FALSE;
+					replay->checkpoints = checkpoints;
+				}
+				replay->checkpoints[replay->checkpointCount].steps  = checkpoint.steps;
+				replay->checkpoints[replay->checkpointCount].inputs = checkpoint.inputs;
+				replay->checkpoints[replay->checkpointCount].offset = offset;
+				replay->checkpointCount++;
+				while (record.value-- > 0) {
+					if ((fread(&p, sizeof(int), 1, replay->file) != 1) || (p < 0) ||
+					    (p >= DPAGES(dSize)))
+						return FALSE;
+					words = pageWords(dSize, p);
+					if (!indexPage(replay, p, ftell(replay->file)) ||
+					    (fseek(replay->file, (long) words * sizeof(int), SEEK_CUR) != 0))
+						return FALSE;
+				}
+				break;
+
+			case TMR_END:
+				if (fread(&steps, sizeof(steps), 1, replay->file) != 1) return FALSE;
+				replay->endSteps  = steps;
+				replay->endResult = record.value;
+				return TRUE;
+
+			default:
+				return FALSE;
+		}
+	}
+	/* a log cut short by a crash still replays up to its last record */
+	return replay->checkpointCount > 0;
+} /* readLog */
+
+static void freeReplay(TMReplay* replay) {
+	int p;
+	if (replay->pages != NULL)
+		for (p = 0; p < DPAGES(replay->context->dSize); p++) {
+			free(replay->pages[p].checkpoints);
+			free(replay->pages[p].offsets);
+		}
+	free(replay->pages);
+	free(replay->values);
+	free(replay->checkpoints);
+	free(replay);
+} /* freeReplay */
+
+/********************************************/
+TMReplay* tmReplayOpen(TMContext* context, FILE* file) {
+	TMReplay* replay = calloc(1, sizeof(TMReplay));
+	TmrHeader header;
+	if (replay == NULL) return NULL;
+	replay->context  = context;
+	replay->file     = file;
+	replay->endSteps = -1;
+	if ((fread(&header, sizeof(header), 1, file) != 1) || (header.magic != TMR_MAGIC) ||
+	    (header.version != TMR_VERSION) || (header.program != programHash(context->program)) ||
+	    (header.dSize != context->dSize) || !readLog(replay)) {
+		freeReplay(replay);
+		return NULL;
+	}
+	replay->input   = context->input;
+	replay->output  = context->output;
+	replay->halt    = context->halt;
+	replay->user    = context->user;
+	context->input  = replayInput;
+	context->output = replayOutput;
+	context->halt   = replayHalt;
+	context->user   = replay;
+	tmReset(context);
+	return replay;
+} /* tmReplayOpen */
+
+/* return to the state of checkpoint k: tmReset, then for every page the version written by the
+ * last checkpoint up to k that wrote it, so each page is read once
+ */
+static int restoreCheckpoint(TMReplay* replay, int k) {
+	TMContext*       context = replay->context;
+	const PAGEINDEX* index;
+	TmrRecord        record;
+	TmrCheckpoint    checkpoint;
+	int              p, lo, hi, mid, words;
+	if ((fseek(replay->file, replay->checkpoints[k].offset, SEEK_SET) != 0) ||
+	    (fread(&record, sizeof(record), 1, replay->file) != 1) ||
+	    (fread(&checkpoint, sizeof(checkpoint), 1, replay->file) != 1))
+		return FALSE;
+	tmReset(context);
+	for (p = 0; p < DPAGES(context->dSize); p++) {
+		index = &replay->pages[p];
+		if ((index->count == 0) || (index->checkpoints[0] > k)) continue;
+		lo = 0, hi = index->count - 1;
+		while (lo < hi) { /* the last version at or before k */
+			mid = (lo + hi + 1) / 2;
+			if (index->checkpoints[mid] <= k)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		words = pageWords(context->dSize, p);
+		if ((fseek(replay->file, index->offsets[lo], SEEK_SET) != 0) ||
+		    (fread(context->dMem + ((size_t) p << DPAGE_SHIFT), sizeof(int), words,
+		           replay->file) != (size_t) words))
+			return FALSE;
+		context->pages[p] |= DPAGE_STORE;
+	}
+	for (p = 0; p < NO_REGS; p++) context->reg[p] = checkpoint.reg[p];
+	for (p = 0; p < 3; p++) context->classCount[p] = checkpoint.classCount[p];
+	context->steps = checkpoint.steps;
+	replay->pos    = checkpoint.inputs;
+	return TRUE;
+} /* restoreCheckpoint */
+
+/********************************************/
+int tmReplaySeek(TMReplay* replay, long step, STEPRESULT* result) {
+	TMContext* context = replay->context;
+	int        lo = 0, hi = replay->checkpointCount - 1, mid;
+	while (lo < hi) { /* the last checkpoint at or before step */
+		mid = (lo + hi + 1) / 2;
+		if (replay->checkpoints[mid].steps <= step)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	/* going forward past no checkpoint runs on from where the context is */
+	if ((context->steps > step) || (replay->checkpoints[lo].steps > context->steps))
+		if (!restoreCheckpoint(replay, lo)) return FALSE;
+	*result = srOKAY;
+	if (context->steps == step) return TRUE;
+	*result = tmRun(context, step - context->steps);
+	if (*result == srBUDGET) *result = srOKAY;
+	return TRUE;
+} /* tmReplaySeek */
+
+/********************************************/
+long tmReplaySteps(const TMReplay* replay) {
+	return replay->endSteps;
+} /* tmReplaySteps */
+
+/********************************************/
+void tmReplayClose(TMReplay* replay) {
+	TMContext* context = replay->context;
+	context->input     = replay->input;
+	context->output    = replay->output;
+	context->halt      = replay->halt;
+	context->user      = replay->user;
+	freeReplay(replay);
+} /* tmReplayClose */
@@ -0,0 +1,640 @@
+/****************************************************/
+/* File: tmrun.c                                    */
+/* Execution of TM programs: contexts, the step     */
+/* and threaded engines                             */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "tmint.h"
+
+/* data memories of at least this many bytes are cleared by mapping fresh pages */
+#define DMEM_REMAP_SIZE (64 * 1024)
+
+/* instructions run between two looks at the clock when a context has a time limit */
+#define TIME_SLICE (1L << 20)
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/********************************************/
+/* Map zero-filled data memory. Pages are committed by the host on first touch, so a large data
+ * memory costs nothing for a small program.
+ */
+int* mapMemory(size_t words) {
+	void* map = mmap(NULL, words * sizeof(int), PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+	return (map == MAP_FAILED) ? NULL : map;
+} /* mapMemory */
+
+/********************************************/
+/* registers, instruction counter and initial data memory words of a new execution */
+static void startContext(TMContext* context) {
+	const TMProgram* program = context->program;
+	int              i;
+	memset(context->reg, 0, sizeof(context->reg));
+	context->dMem[0]  = context->dSize - 1;
+	context->pages[0] |= DPAGE_STORE;
+	for (i = 0; i < program->dataCount; i++)
+		if (program->dataImage[i].address < context->dSize) {
+			context->dMem[program->dataImage[i].address] = program->dataImage[i].value;
+			context->pages[program->dataImage[i].address >> DPAGE_SHIFT] |= DPAGE_STORE;
+		}
+	context->steps = 0;
+	memset(context->classCount, 0, sizeof(context->classCount));
+} /* startContext */
+
+/********************************************/
+static int noInput(void* user, int* value) {
+	return FALSE;
+} /* noInput */
+
+/********************************************/
+static void printOutput(void* user, int value) {
+	printf("OUT instruction prints: %d\n", value);
+} /* printOutput */
+
+/********************************************/
+static void printHalt(void* user, int r, int s, int t) {
+	printf("HALT: %1d,%1d,%1d\n", r, s, t);
+} /* printHalt */
+
+/********************************************/
+TMContext* tmContextNew(const TMProgram* program, int dSize) {
+	TMContext* context = calloc(1, sizeof(TMContext));
+	if (context == NULL) return NULL;
+	context->dSize = (dSize > 0) ? dSize : DADDR_SIZE;
+	context->dMem  = mapMemory(context->dSize);
+	context->pages = calloc(DPAGES(context->dSize), 1);
+	if ((context->dMem == NULL) || (context->pages == NULL)) {
+		if (context->dMem != NULL) munmap(context->dMem, (size_t) context->dSize * sizeof(int));
+		free(context->pages);
+		free(context);
+		return NULL;
+	}
+	context->program = program;
+	context->engine  = engSTEP;
+	context->input   = noInput;
+	context->output  = printOutput;
+	context->halt    = printHalt;
+	startContext(context);
+	return context;
+} /* tmContextNew */
+
+/********************************************/
+void tmContextFree(TMContext* context) {
+	if (context == NULL) return;
+	munmap(context->dMem, (size_t) context->dSize * sizeof(int));
+	free(context->pages);
+	free(context->watchTab);
+	free(context);
+} /* tmContextFree */
+
+/********************************************/
+void tmReset(TMContext* context) {
+	size_t bytes = (size_t) context->dSize * sizeof(int);
+	int*   fresh = (bytes >= DMEM_REMAP_SIZE) ? mapMemory(context->dSize) : NULL;
+	int    p;
+	if (fresh != NULL) {
+		munmap(context->dMem, bytes);
+		context->dMem = fresh;
+	} else
+		memset(context->dMem, 0, bytes);
+	for (p = 0; p < DPAGES(context->dSize); p++) context->pages[p] &= DPAGE_WATCH;
+	context->base = NULL;
+	startContext(context);
+} /* tmReset */
+
+/********************************************/
+/* count the instruction at pc, and whether a conditional jump there is taken, before it runs */
+static void countStep(TMProfile* profile, const INSTRUCTION* in, int pc, const int* reg) {
+	int value = reg[in->iarg1];
+	int taken;
+	if (pc >= profile->size) return;
+	profile->count[pc]++;
+	switch (in->iop) {
+		case opJLT:
+			taken = value < 0;
+			break;
+		case opJLE:
+			taken = value <= 0;
+			break;
+		case opJGT:
+			taken = value > 0;
+			break;
+		case opJGE:
+			taken = value >= 0;
+			break;
+		case opJEQ:
+			taken = value == 0;
+			break;
+		case opJNE:
+			taken = value != 0;
+			break;
+		default:
+			return;
+	}
+	profile->taken[pc] += taken;
+} /* countStep */
+
+/* the next record of a trace, writing the full buffer out first if the trace has a file */
+static TmtRecord* traceStep(TMTrace* trace, const INSTRUCTION* in, int pc, const int* reg) {
+	TmtRecord* record;
+	if ((trace->file != NULL) && (trace->count - trace->written == trace->size))
+		tmTraceFlush(trace);
+	record          = &trace->ring[trace->count++ % trace->size];
+	record->pc      = pc;
+	record->op      = in->iop;
+	record->value   = reg[in->iarg1];
+	record->address = -1;
+	return record;
+} /* traceStep */
+
+/********************************************/
+STEPRESULT stepTM(TMContext* context) {
+	const INSTRUCTION* currentinstruction;
+	int*               reg  = context->reg;
+	int*               dMem   = context->dMem;
+	TmtRecord*         record = NULL;
+	int                pc;
+	int                r, s, t, m, opClass;
+
+	pc = reg[PC_REG];
+	if ((pc < 0) || (pc >= context->program->iSize)) return srIMEM_ERR;
+	reg[PC_REG]        = pc + 1;
+	currentinstruction = &context->program->iMem[pc];
+	if (context->profile != NULL) countStep(context->profile, currentinstruction, pc, reg);
+	if (context->trace != NULL) record = traceStep(context->trace, currentinstruction, pc, reg);
+	r                  = currentinstruction->iarg1;
+	opClass            = tmOpClass(currentinstruction->iop);
+	context->classCount[opClass]++;
+	switch (opClass) {
+		case opclRR:
+			/***********************************/
+			s = currentinstruction->iarg2;
+			t = currentinstruction->iarg3;
+			m = 0;
+			break;
+
+		case opclRM:
+			/***********************************/
+			s = currentinstruction->iarg3;
+			t = 0;
+			m = currentinstruction->iarg2 + reg[s];
+			if (record != NULL) record->address = m;
+			if ((m < 0) || (m >= context->dSize)) return srDMEM_ERR;
+			if (context->memProfile != NULL) memAccess(context->memProfile, context, pc, m);
+			break;
+
+		case opclRA:
+		default:
+			/***********************************/
+			s = currentinstruction->iarg3;
+			t = 0;
+			m = currentinstruction->iarg2 + reg[s];
+			break;
+	} /* case */
+
+	switch (currentinstruction->iop) { /* RR instructions */
+		case opHALT:
+			/***********************************/
+			if (context->halt != NULL) context->halt(context->user, r, s, t);
+			return srHALT;
+			/* break; */
+
+		case opIN:
+			/***********************************/
+			if (!context->input(context->user, &reg[r])) return srNO_INPUT;
+			break;
+
+		case opOUT:
+			context->output(context->user, reg[r]);
+			break;
+		case opADD:
+			reg[r] = reg[s] + reg[t];
+			break;
+		case opSUB:
+			reg[r] = reg[s] - reg[t];
+			break;
+		case opMUL:
+			reg[r] = reg[s] * reg[t];
+			break;
+
+		case opDIV:
+			/***********************************/
+			if (reg[t] != 0)
+				reg[r] = reg[s] / reg[t];
+			else
+				return srZERODIVIDE;
+			break;
+
+		/*************** RM instructions ********************/
+		case opLD:
+			reg[r] = dMem[m];
+			break;
+		case opST:
+			dMem[m] = reg[r];
+			context->pages[m >> DPAGE_SHIFT] |= DPAGE_STORE;
+			if ((context->pages[m >> DPAGE_SHIFT] & DPAGE_WATCH) && watchedAddress(context, m)) {
+				context->watchHit = m;
+				return srWATCH;
+			}
+			break;
+
+		/*************** RA instructions ********************/
+		case opLDA:
+			reg[r] = m;
+			break;
+		case opLDC:
+			reg[r] = currentinstruction->iarg2;
+			break;
+		case opJLT:
+			if (reg[r] < 0) reg[PC_REG] = m;
+			break;
+		case opJLE:
+			if (reg[r] <= 0) reg[PC_REG] = m;
+			break;
+		case opJGT:
+			if (reg[r] > 0) reg[PC_REG] = m;
+			break;
+		case opJGE:
+			if (reg[r] >= 0) reg[PC_REG] = m;
+			break;
+		case opJEQ:
+			if (reg[r] == 0) reg[PC_REG] = m;
+			break;
+		case opJNE:
+			if (reg[r] != 0) reg[PC_REG] = m;
+			break;
+
+			/* end of legal instructions */
+	} /* case */
+	if (record != NULL) record->value = reg[r];
+	return srOKAY;
+} /* stepTM */
+
+/********************************************/
+/* Bind the decoded instructions of a program to their handlers (context == NULL) or execute
+ * them until a result other than srOKAY or until context->steps reaches stop, with the same
+ * results, faults and instruction counts as stepTM. Only RM and RA instructions are counted as
+ * they run; the RR count is what remains of the steps, less those executed by stepTM (which
+ * counts them itself) and an Instruction Memory Fault.
+ */
+STEPRESULT runThreaded(TMContext* context, long stop, TMProgram* bind) {
+	static void* handlerTab[hLim] = {
+	    &&do_STEP,  &&do_ADD,   &&do_SUB,   &&do_MUL,   &&do_DIV,   &&do_LD,    &&do_LDPC,
+	    &&do_ST,    &&do_LDA,   &&do_LDC,   &&do_JMP,   &&do_JLT,   &&do_JLE,   &&do_JGT,
+	    &&do_JGE,   &&do_JEQ,   &&do_JNE,   &&do_RELLT, &&do_RELLE, &&do_RELGT, &&do_RELGE,
+	    &&do_RELEQ, &&do_RELNE, &&do_LDADD, &&do_LDSUB, &&do_LDMUL, &&do_LDDIV, &&do_STLD,
+	    &&do_STLDC, &&do_IDXLD, &&do_IDXST, &&do_JMPK,  &&do_JLTK,  &&do_JLEK,  &&do_JGTK,
+	    &&do_JGEK,  &&do_JEQK,  &&do_JNEK,  &&do_BREAK};
+	const DECODED* dCode;
+	const DECODED* ip;
+	int*           dMem;
+	unsigned char* pages;
+	STEPRESULT     stepResult;
+	int            rg[NO_REGS + 1];
+	unsigned       iSize, dSize;
+	int            pc, m, loc, n;
+	long           steps, start;
+	long           rm = 0, ra = 0, other = 0; /* RM, RA and not native instructions */
+
+	if (context == NULL) {
+		for (loc = 0; loc < bind->iSize; loc++) {
+			/* a superinstruction may not run over a breakpoint inside it */
+			m = bind->dCode[loc].fused;
+			for (n = 1; m && (bind->breakCount > 0) && (n < fusedLength(m)); n++)
+				if (bind->breakpoints[loc + n]) m = hSTEP;
+			if (!m && bind->dCode[loc].verified) m = hJMPK + (bind->dCode[loc].kind - hJMP);
+			if ((bind->breakCount > 0) && bind->breakpoints[loc]) m = hBREAK;
+			bind->dCode[loc].handler = handlerTab[m ? m : bind->dCode[loc].kind];
+		}
+		bind->dCode[bind->iSize].handler = &&imemErr;
+		return srOKAY;
+	}
+	dCode = context->program->dCode;
+	dMem  = context->dMem;
+	pages = context->pages;
+	iSize = context->program->iSize;
+	dSize = context->dSize;
+	steps = context->steps;
+	start = steps;
+
+#define DISPATCH()                                     \
+	do {                                               \
+		if (steps >= stop) goto budget;                \
+		steps++;                                       \
+		if ((unsigned) pc >= iSize) goto imemErr;      \
+		ip = &dCode[pc];                               \
+		goto* ip->handler;                             \
+	} while (0)
+/* dispatch to a location proven in iMem or to the faulting entry at iSize */
+#define DISPATCH_VERIFIED()                            \
+	do {                                               \
+		if (steps >= stop) goto budget;                \
+		steps++;                                       \
+		ip = &dCode[pc];                               \
+		goto* ip->handler;                             \
+	} while (0)
+#define NEXT()               \
+	do {                     \
+		pc++;                \
+		DISPATCH_VERIFIED(); \
+	} while (0)
+/* a superinstruction covering n more instructions runs only if the limit allows all of them,
+ * otherwise its first instruction is executed alone
+ */
+#define ROOM(n, single) \
+	if (stop - steps < (n)) goto single
+#define RELOP(cond)                     \
+	do {                                \
+		ROOM(3, do_SUB);                \
+		m = rg[ip->s] - rg[ip->t];      \
+		rg[ip->r] = (m cond 0);         \
+		m         = (m cond 0) ? 2 : 3; \
+		steps += m;                     \
+		ra += m;                        \
+		pc += 5;                        \
+		DISPATCH_VERIFIED();            \
+	} while (0)
+#define SKIP(n)       \
+	do {              \
+		steps += (n); \
+		pc += (n);    \
+		ip += (n);    \
+	} while (0)
+#define LOAD(next)                                    \
+	do {                                              \
+		ROOM(1, do_LD);                               \
+		rm++;                                         \
+		m = ip->d + rg[ip->s];                        \
+		if ((unsigned) m >= dSize) goto dmemErr;      \
+		rg[ip->r] = dMem[m];                          \
+		SKIP(1);                                      \
+		goto next;                                    \
+	} while (0)
+#define STORE(next)                                   \
+	do {                                              \
+		ROOM(1, do_ST);                               \
+		rm++;                                         \
+		m = ip->d + rg[ip->s];                        \
+		if ((unsigned) m >= dSize) goto dmemErr;      \
+		if (pages[m >> DPAGE_SHIFT] & DPAGE_WATCH)    \
+			goto watch;                               \
+		dMem[m]                 = rg[ip->r];          \
+		pages[m >> DPAGE_SHIFT] = DPAGE_STORE;        \
+		SKIP(1);                                      \
+		goto next;                                    \
+	} while (0)
+#define INDEX(next)                                     \
+	do {                                                \
+		ROOM(3, do_LDC);                                \
+		ra++;                                           \
+		rg[ip[0].r] = ip[0].d;                          \
+		rg[ip[1].r] = rg[ip[1].s] + rg[ip[1].t];        \
+		rg[ip[2].r] = rg[ip[2].s] - rg[ip[2].t];        \
+		SKIP(3);                                        \
+		goto next;                                      \
+	} while (0)
+#define BRANCH(cond)                    \
+	do {                                \
+		ra++;                           \
+		if (cond)                       \
+			pc = ip->d + rg[ip->s];     \
+		else                            \
+			pc++;                       \
+		DISPATCH();                     \
+	} while (0)
+#define BRANCH_VERIFIED(cond)           \
+	do {                                \
+		ra++;                           \
+		if (cond)                       \
+			pc = ip->d;                 \
+		else                            \
+			pc++;                       \
+		DISPATCH_VERIFIED();            \
+	} while (0)
+
+	for (loc = 0; loc < NO_REGS; loc++) rg[loc] = context->reg[loc];
+	rg[ZERO_REG] = 0;
+	pc           = context->reg[PC_REG];
+	DISPATCH();
+
+do_STEP:
+	other++;
+	for (loc = 0; loc < NO_REGS; loc++) context->reg[loc] = rg[loc];
+	context->reg[PC_REG] = pc;
+	stepResult           = stepTM(context);
+	for (loc = 0; loc < NO_REGS; loc++) rg[loc] = context->reg[loc];
+	pc = context->reg[PC_REG];
+	if (stepResult != srOKAY) goto done;
+	DISPATCH();
+do_ADD:
+	rg[ip->r] = rg[ip->s] + rg[ip->t];
+	NEXT();
+do_SUB:
+	rg[ip->r] = rg[ip->s] - rg[ip->t];
+	NEXT();
+do_MUL:
+	rg[ip->r] = rg[ip->s] * rg[ip->t];
+	NEXT();
+do_DIV:
+	if (rg[ip->t] == 0) {
+		pc++;
+		stepResult = srZERODIVIDE;
+		goto done;
+	}
+	rg[ip->r] = rg[ip->s] / rg[ip->t];
+	NEXT();
+do_LD:
+	rm++;
+	m = ip->d + rg[ip->s];
+	if ((unsigned) m >= dSize) goto dmemErr;
+	rg[ip->r] = dMem[m];
+	NEXT();
+do_LDPC:
+	rm++;
+	m = ip->d + rg[ip->s];
+	if ((unsigned) m >= dSize) goto dmemErr;
+	pc = dMem[m];
+	DISPATCH();
+do_ST:
+	rm++;
+	m = ip->d + rg[ip->s];
+	if ((unsigned) m >= dSize) goto dmemErr;
+	if (pages[m >> DPAGE_SHIFT] & DPAGE_WATCH) goto watch;
+	dMem[m]                 = rg[ip->r];
+	pages[m >> DPAGE_SHIFT] = DPAGE_STORE;
+	NEXT();
+do_LDA:
+	ra++;
+	rg[ip->r] = ip->d + rg[ip->s];
+	NEXT();
+do_LDC:
+	ra++;
+	rg[ip->r] = ip->d;
+	NEXT();
+do_JMP:
+	ra++;
+	pc = ip->d + rg[ip->s];
+	DISPATCH();
+do_JLT:
+	BRANCH(rg[ip->r] < 0);
+do_JLE:
+	BRANCH(rg[ip->r] <= 0);
+do_JGT:
+	BRANCH(rg[ip->r] > 0);
+do_JGE:
+	BRANCH(rg[ip->r] >= 0);
+do_JEQ:
+	BRANCH(rg[ip->r] == 0);
+do_JNE:
+	BRANCH(rg[ip->r] != 0);
+do_RELLT:
+	RELOP(<);
+do_RELLE:
+	RELOP(<=);
+do_RELGT:
+	RELOP(>);
+do_RELGE:
+	RELOP(>=);
+do_RELEQ:
+	RELOP(==);
+do_RELNE:
+	RELOP(!=);
+do_LDADD:
+	LOAD(do_ADD);
+do_LDSUB:
+	LOAD(do_SUB);
+do_LDMUL:
+	LOAD(do_MUL);
+do_LDDIV:
+	LOAD(do_DIV);
+do_STLD:
+	STORE(do_LD);
+do_STLDC:
+	STORE(do_LDC);
+do_IDXLD:
+	INDEX(do_LD);
+do_IDXST:
+	INDEX(do_ST);
+do_JMPK:
+	ra++;
+	pc = ip->d;
+	DISPATCH_VERIFIED();
+do_JLTK:
+	BRANCH_VERIFIED(rg[ip->r] < 0);
+do_JLEK:
+	BRANCH_VERIFIED(rg[ip->r] <= 0);
+do_JGTK:
+	BRANCH_VERIFIED(rg[ip->r] > 0);
+do_JGEK:
+	BRANCH_VERIFIED(rg[ip->r] >= 0);
+do_JEQK:
+	BRANCH_VERIFIED(rg[ip->r] == 0);
+do_JNEK:
+	BRANCH_VERIFIED(rg[ip->r] != 0);
+do_BREAK:
+	steps--;
+	stepResult = srBREAK;
+	goto done;
+
+#undef INDEX
+#undef STORE
+#undef LOAD
+#undef SKIP
+#undef RELOP
+#undef ROOM
+#undef BRANCH_VERIFIED
+#undef BRANCH
+#undef NEXT
+#undef DISPATCH_VERIFIED
+#undef DISPATCH
+
+watch:
+	/* a store into a watched page is left to stepTM, which knows the watched ranges */
+	rm--;
+	goto do_STEP;
+dmemErr:
+	pc++;
+	stepResult = srDMEM_ERR;
+	goto done;
+imemErr:
+	other++;
+	stepResult = srIMEM_ERR;
+	goto done;
+budget:
+	stepResult = srBUDGET;
+done:
+	for (loc = 0; loc < NO_REGS; loc++) context->reg[loc] = rg[loc];
+	context->reg[PC_REG] = pc;
+	context->steps       = steps;
+	context->classCount[opclRR] += steps - start - rm - ra - other;
+	context->classCount[opclRM] += rm;
+	context->classCount[opclRA] += ra;
+	return stepResult;
+} /* runThreaded */
+
+/********************************************/
+STEPRESULT tmStep(TMContext* context) {
+	context->steps++;
+	return stepTM(context);
+} /* tmStep */
+
+/********************************************/
+/* run the context's engine until context->steps reaches stop */
+static STEPRESULT runEngine(TMContext* context, long stop) {
+	const TMProgram* program    = context->program;
+	STEPRESULT       stepResult = srOKAY;
+	int              stepOnly   = (context->profile != NULL) || (context->trace != NULL) ||
+	                       (context->memProfile != NULL);
+	if ((context->engine == engTHREADED) && !stepOnly) return runThreaded(context, stop, NULL);
+	if ((context->engine == engJIT) && !stepOnly) return runJIT(context, stop);
+	while (stepResult == srOKAY) {
+		if (context->steps >= stop) return srBUDGET;
+		if ((program->breakCount > 0) && ((unsigned) context->reg[PC_REG] < program->iSize) &&
+		    program->breakpoints[context->reg[PC_REG]])
+			return srBREAK;
+		stepResult = stepTM(context);
+		context->steps++;
+	}
+	return stepResult;
+} /* runEngine */
+
+/********************************************/
+long clockMillis(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+} /* clockMillis */
+
+/********************************************/
+STEPRESULT tmRun(TMContext* context, long budget) {
+	STEPRESULT stepResult;
+	long       stop, deadline;
+	stop = ((budget > 0) && (context->steps <= LONG_MAX - budget)) ? context->steps + budget
+	                                                               : LONG_MAX;
+	if (tmBreakpointAt(context->program, context->reg[PC_REG]) && (context->steps < stop)) {
+		/* continue from a breakpoint: its instruction runs before the engines look at it */
+		context->steps++;
+		stepResult = stepTM(context);
+		if (stepResult != srOKAY) return stepResult;
+	}
+	if (context->timeLimit <= 0) return runEngine(context, stop);
+	/* the engines see a time limit as a series of smaller budgets */
+	deadline = clockMillis() + context->timeLimit;
+	for (;;) {
+		stepResult = runEngine(context, (stop - context->steps > TIME_SLICE)
+		                                    ? context->steps + TIME_SLICE
+		                                    : stop);
+		if ((stepResult != srBUDGET) || (context->steps >= stop)) return stepResult;
+		if (clockMillis() >= deadline) return srTIMEOUT;
+	}
+} /* tmRun */
@@ -0,0 +1,91 @@
+/****************************************************/
+/* File: tmsnap.c                                   */
+/* Snapshots of TM execution states                 */
+/****************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmint.h"
+
+#define DPAGE_WORDS (1 << DPAGE_SHIFT)
+
+/********************************************/
+/* words of page p of a data memory of dSize words; the last page may be partial */
+int pageWords(int dSize, int p) {
+	int left = dSize - (p << DPAGE_SHIFT);
+	return (left < DPAGE_WORDS) ? left : DPAGE_WORDS;
+} /* pageWords */
+
+/********************************************/
+TMSnapshot* tmSnapshot(TMContext* context) {
+	TMSnapshot* snapshot = calloc(1, sizeof(TMSnapshot));
+	int         pages    = DPAGES(context->dSize);
+	int         p, n = 0;
+	if (snapshot == NULL) return NULL;
+	for (p = 0; p < pages; p++)
+		if (context->pages[p] & DPAGE_WRITTEN) n++;
+	snapshot->slot = malloc(pages * sizeof(int));
+	snapshot->data = malloc(((size_t) n << DPAGE_SHIFT) * sizeof(int) + 1);
+	if ((snapshot->slot == NULL) || (snapshot->data == NULL)) {
+		tmSnapshotFree(snapshot);
+		return NULL;
+	}
+	n = 0;
+	for (p = 0; p < pages; p++) {
+		if (context->pages[p] & DPAGE_WRITTEN) {
+			snapshot->slot[p] = n;
+			memcpy(snapshot->data + ((size_t) n++ << DPAGE_SHIFT),
+			       context->dMem + ((size_t) p << DPAGE_SHIFT),
+			       pageWords(context->dSize, p) * sizeof(int));
+		} else
+			snapshot->slot[p] = -1;
+		context->pages[p] &= ~DPAGE_DIRTY;
+	}
+	memcpy(snapshot->reg, context->reg, sizeof(snapshot->reg));
+	memcpy(snapshot->classCount, context->classCount, sizeof(snapshot->classCount));
+	snapshot->steps = context->steps;
+	snapshot->dSize = context->dSize;
+	snapshot->owner = context;
+	context->base   = snapshot;
+	return snapshot;
+} /* tmSnapshot */
+
+/********************************************/
+/* Pages that are not dirty already equal the snapshot the context is based on; any other
+ * snapshot requires every page that was written since tmReset or is saved in it.
+ */
+int tmRestore(TMContext* context, const TMSnapshot* snapshot) {
+	int  pages = DPAGES(context->dSize);
+	int  based = (context->base == snapshot) && (snapshot->owner == context);
+	int* page;
+	int  p;
+	if (snapshot->dSize != context->dSize) return FALSE;
+	for (p = 0; p < pages; p++) {
+		if (based ? !(context->pages[p] & DPAGE_DIRTY)
+		          : !(context->pages[p] & DPAGE_WRITTEN) && (snapshot->slot[p] < 0))
+			continue;
+		page = context->dMem + ((size_t) p << DPAGE_SHIFT);
+		if (snapshot->slot[p] >= 0) {
+			memcpy(page, snapshot->data + ((size_t) snapshot->slot[p] << DPAGE_SHIFT),
+			       pageWords(context->dSize, p) * sizeof(int));
+			context->pages[p] = (context->pages[p] & DPAGE_WATCH) | DPAGE_WRITTEN;
+		} else {
+			memset(page, 0, pageWords(context->dSize, p) * sizeof(int));
+			context->pages[p] &= DPAGE_WATCH;
+		}
+	}
+	memcpy(context->reg, snapshot->reg, sizeof(context->reg));
+	memcpy(context->classCount, snapshot->classCount, sizeof(context->classCount));
+	context->steps = snapshot->steps;
+	context->base  = (snapshot->owner == context) ? snapshot : NULL;
+	return TRUE;
+} /* tmRestore */
+
+/********************************************/
+void tmSnapshotFree(TMSnapshot* snapshot) {
+	if (snapshot == NULL) return;
+	free(snapshot->slot);
+	free(snapshot->data);
+	free(snapshot);
+} /* tmSnapshotFree */
@@ -0,0 +1,64 @@
+/****************************************************/
+/* File: tmtrc.c                                    */
+/* Binary execution traces of TM programs           */
+/****************************************************/
+
+#include <stdlib.h>
+
+#include "tmint.h"
+
+static int writeHeader(FILE* f, long skipped) {
+	TmtHeader header;
+	header.magic   = TMT_MAGIC;
+	header.version = TMT_VERSION;
+	header.skipped = skipped;
+	return fwrite(&header, sizeof(header), 1, f) == 1;
+} /* writeHeader */
+
+/* records first..last-1 of the ring, oldest first */
+static int writeRecords(const TMTrace* trace, long first, long last, FILE* f) {
+	long n;
+	while (first < last) {
+		n = trace->size - first % trace->size;
+		if (n > last - first) n = last - first;
+		if (fwrite(&trace->ring[first % trace->size], sizeof(TmtRecord), n, f) != (size_t) n)
+			return FALSE;
+		first += n;
+	}
+	return TRUE;
+} /* writeRecords */
+
+/********************************************/
+TMTrace* tmTraceNew(int size, FILE* file) {
+	TMTrace* trace = calloc(1, sizeof(TMTrace));
+	if (trace == NULL) return NULL;
+	trace->size = (size > 0) ? size : 1;
+	trace->ring = malloc(trace->size * sizeof(TmtRecord));
+	trace->file = file;
+	if ((trace->ring == NULL) || ((file != NULL) && !writeHeader(file, 0))) {
+		tmTraceFree(trace);
+		return NULL;
+	}
+	return trace;
+} /* tmTraceNew */
+
+/********************************************/
+int tmTraceFlush(TMTrace* trace) {
+	if (trace->file == NULL) return TRUE;
+	if (!writeRecords(trace, trace->written, trace->count, trace->file)) trace->error = TRUE;
+	trace->written = trace->count;
+	return !trace->error;
+} /* tmTraceFlush */
+
+/********************************************/
+int tmTraceWrite(const TMTrace* trace, FILE* file) {
+	long first = (trace->count > trace->size) ? trace->count - trace->size : 0;
+	return writeHeader(file, first) && writeRecords(trace, first, trace->count, file);
+} /* tmTraceWrite */
+
+/********************************************/
+void tmTraceFree(TMTrace* trace) {
+	if (trace == NULL) return;
+	free(trace->ring);
+	free(trace);
+} /* tmTraceFree */
@@ -11,7 +11,12 @@ static int location = 0;
 /**
  * @brief Offset for local memory allocation.
  */
-static int localMemoryOffset = MAX_MEMORY - 2;
+static int localMemoryOffset;
+
+/**
+ * @brief Lowest local memory offset of any function, which bounds the largest frame.
+ */
+static int lowestLocalMemoryOffset;
 
 /**
  * @brief Offset for global memory allocation.
@@ -117,7 +122,7 @@ static void insertNode(TreeNode* node) {
 					compoundScopeFromFunctionDeclaration = TRUE;
 					if (strcmp(node->attr.name, "main") == 0) declaredMainFunction = TRUE;
 
-					localMemoryOffset = MAX_MEMORY - 2;
+					localMemoryOffset = MaxMemory - 2;
 
 					if (symbolTableLookup(node->attr.name)) {
 						pce("Semantic error at line %d: %s was already declared\n",
@@ -125,7 +130,7 @@ static void insertNode(TreeNode* node) {
 						Error = TRUE;
 						break;
 					}
-					symbolTableInsert(node->attr.name, node->lineno, MAX_MEMORY - 1, node->type,
+					symbolTableInsert(node->attr.name, node->lineno, MaxMemory - 1, node->type,
 					                  node->kind.stmt, node->isArray, "global");
 					enterScope(node->attr.name);
 					currentFunction = node->attr.name;
@@ -257,6 +262,7 @@ static void insertNode(TreeNode* node) {
 		default:
 			break;
 	}
+	if (localMemoryOffset < lowestLocalMemoryOffset) lowestLocalMemoryOffset = localMemoryOffset;
 }
 
 /**
@@ -394,8 +400,16 @@ void buildSymbolTable(TreeNode* syntaxTree) {
 	symbolTableInsert("input", -1, location++, Integer, FuncK, FALSE, "global");
 	symbolTableInsert("output", -1, location++, Void, FuncK, FALSE, "global");
 
+	localMemoryOffset       = MaxMemory - 2;
+	lowestLocalMemoryOffset = localMemoryOffset;
 	traverse(syntaxTree, insertNode, exitScope);
 	exitScope(syntaxTree);
+	if (globalMemoryOffset + (MaxMemory - lowestLocalMemoryOffset) > MaxMemory + 1) {
+		pce("Semantic error: globals and the largest frame need %d words of data memory, the "
+		    "target has %d (see -m)\n",
+		    globalMemoryOffset + (MaxMemory - lowestLocalMemoryOffset), MaxMemory + 1);
+		Error = TRUE;
+	}
 	if (TraceAnalyze) {
 		pc("\nSymbol table:\n\n");
 		printSymbolTable();
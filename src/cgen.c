@@ -38,8 +38,164 @@ static bool isFirstDeclaredFunction = TRUE;
  */
 static int mainFunctionMemoryLocation = 3;
 
+/**
+ * Registers that hold expression temporaries when AllocateRegisters is TRUE, in allocation
+ * order. Indexing then uses INDEX_POINTER alone, and nothing reads MEMORY_POINTER after the
+ * prelude.
+ */
+static const int temporaryRegisters[] = {ACCUMULATOR_2, MEMORY_POINTER};
+
+/**
+ * Number of entries in temporaryRegisters.
+ */
+#define TEMPORARY_REGISTERS 2
+
+/**
+ * Number of temporaryRegisters holding a value.
+ */
+static int usedTemporaryRegisters = 0;
+
 static void cGen(TreeNode* tree);
 
+/**
+ * Loads 0 into the global pointer before a global access, unless the prelude did it for good.
+ */
+static void loadGlobalPointer(void) {
+	if (!AllocateRegisters) emitRM("LDC", GLOBAL_POINTER, 0, 0, "load 0");
+}
+
+/**
+ * Adds 1 to the index register, as arrays are indexed downwards from the slot after their base.
+ */
+static void incrementIndex(void) {
+	if (AllocateRegisters)
+		emitRM("LDA", INDEX_POINTER, 1, INDEX_POINTER, "add 1 to the index");
+	else {
+		emitRM("LDC", ACCUMULATOR_2, 1, 0, "load 1");
+		emitRO("ADD", INDEX_POINTER, INDEX_POINTER, ACCUMULATOR_2, "sub 3 by 1");
+	}
+}
+
+/**
+ * Whether an expression calls a function, input and output included.
+ */
+static bool hasCall(const TreeNode* node) {
+	if (!node) return FALSE;
+	if (node->nodekind == ExpK && node->kind.exp == CallK) return TRUE;
+	for (int i = 0; i < MAXCHILDREN; i++)
+		if (hasCall(node->child[i])) return TRUE;
+	return FALSE;
+}
+
+/**
+ * Whether an expression calls a function other than input and output, which may use every
+ * register.
+ */
+static bool hasFunctionCall(const TreeNode* node) {
+	if (!node) return FALSE;
+	if (node->nodekind == ExpK && node->kind.exp == CallK &&
+	    strcmp(node->attr.name, "input") != 0 && strcmp(node->attr.name, "output") != 0)
+		return TRUE;
+	for (int i = 0; i < MAXCHILDREN; i++)
+		if (hasFunctionCall(node->child[i])) return TRUE;
+	return FALSE;
+}
+
+/**
+ * Sethi-Ullman number of an expression: the temporary registers needed to evaluate it without
+ * spilling, when the operand that needs more of them is evaluated first.
+ */
+static int registerNeed(const TreeNode* node) {
+	if (!node || node->nodekind != ExpK || node->kind.exp != OpK) return 0;
+	const int left  = registerNeed(node->child[0]);
+	const int right = registerNeed(node->child[1]);
+	if (left == right) return left + 1;
+	return left > right ? left : right;
+}
+
+/**
+ * Generates the operands of a binary operator, leaving them in the registers returned in left
+ * and right.
+ */
+static void generateOperands(TreeNode* node, int* left, int* right) {
+	*left  = ACCUMULATOR_1;
+	*right = ACCUMULATOR;
+
+	if (AllocateRegisters && usedTemporaryRegisters < TEMPORARY_REGISTERS &&
+	    !hasFunctionCall(node->child[1])) {
+		// The operand needing more registers goes first if the order is not observable
+		const bool rightFirst =
+		    !hasCall(node) && registerNeed(node->child[1]) > registerNeed(node->child[0]);
+		const int temporary = temporaryRegisters[usedTemporaryRegisters];
+
+		cGen(node->child[rightFirst ? 1 : 0]);
+		usedTemporaryRegisters++;
+		emitRM("LDA", temporary, 0, ACCUMULATOR,
+		       rightFirst ? "op: keep right in a register" : "op: keep left in a register");
+		cGen(node->child[rightFirst ? 0 : 1]);
+		usedTemporaryRegisters--;
+
+		*left  = rightFirst ? ACCUMULATOR : temporary;
+		*right = rightFirst ? temporary : ACCUMULATOR;
+	} else {
+		if (node->child[0]) {
+			cGen(node->child[0]);
+		}
+		emitPush(ACCUMULATOR, tmpOffset--, "op: push left");
+
+		if (node->child[1]) {
+			cGen(node->child[1]);
+		}
+		emitPop(ACCUMULATOR_1, ++tmpOffset, "op: load left");
+	}
+}
+
+/**
+ * Generates the condition of an if or while and returns the jump to take to its false target
+ * on ACCUMULATOR. With BranchOnCompare, a relational operator leaves the difference of its
+ * operands there instead of 0 or 1, and the jump is its inverse.
+ */
+static const char* generateCondition(TreeNode* node) {
+	const char* jump = NULL;
+	if (BranchOnCompare && node && node->nodekind == ExpK && node->kind.exp == OpK) {
+		switch (node->attr.op) {
+			case LT:
+				jump = "JGE";
+				break;
+			case LEQ:
+				jump = "JGT";
+				break;
+			case GT:
+				jump = "JLE";
+				break;
+			case GEQ:
+				jump = "JLT";
+				break;
+			case EQ:
+				jump = "JNE";
+				break;
+			case NEQ:
+				jump = "JEQ";
+				break;
+			default:
+				break;
+		}
+	}
+	if (!jump) {
+		if (node) cGen(node);
+		return "JEQ";
+	}
+
+	const int outerLine = emitSourceLine(node->lineno);
+	int       left, right;
+	emitComment("-> Op");
+	generateOperands(node, &left, &right);
+	emitRO("SUB", ACCUMULATOR, left, right, "op: compare");
+	emitComment("<- Op");
+	emitSourceLine(outerLine);
+	return jump;
+}
+
 static void generateStatementCode(TreeNode* node) {
 	int savedLocation1, savedLocation2, savedLocation3;
 
@@ -55,8 +211,10 @@ static void generateStatementCode(TreeNode* node) {
 				mainFunctionMemoryLocation = emitSkip(1);
 				isFirstDeclaredFunction    = FALSE;
 				insert(node->attr.name, mainFunctionMemoryLocation + 1);
+				emitSymbol(node->attr.name, mainFunctionMemoryLocation + 1, node->lineno);
 			} else {
 				insert(node->attr.name, initialLocation);
+				emitSymbol(node->attr.name, initialLocation, node->lineno);
 			}
 
 			currentScopeName = node->attr.name;
@@ -114,7 +272,7 @@ static void generateStatementCode(TreeNode* node) {
 					BucketList symbol = symbolTableLookupFromScope(node->attr.name, node->scope);
 					const int  memoryLocation = symbol->memoryLocation;
 					emitRM("LDC", ACCUMULATOR, memoryLocation, 0, "load global position to ac");
-					emitRM("LDC", GLOBAL_POINTER, 0, 0, "load 0");
+					loadGlobalPointer();
 					emitRM("ST", ACCUMULATOR, memoryLocation, GLOBAL_POINTER,
 					       "store global position");
 					emitComment("<- declare vector");
@@ -163,9 +321,7 @@ static void generateStatementCode(TreeNode* node) {
 			emitComment("-> if");
 
 			// Condition
-			if (node->child[0]) {
-				cGen(node->child[0]);
-			}
+			const char* elseJump = generateCondition(node->child[0]);
 			savedLocation1 = emitSkip(1);
 			emitComment("if: jump to else belongs here");
 
@@ -177,7 +333,7 @@ static void generateStatementCode(TreeNode* node) {
 			emitComment("if: jump to end belongs here");
 
 			emitBackup(savedLocation1);
-			emitRM_Abs("JEQ", ACCUMULATOR, savedLocation2 + 1, "if: jmp to else");
+			emitRM_Abs(elseJump, ACCUMULATOR, savedLocation2 + 1, "if: jmp to else");
 			emitRestore();
 
 			// Else body
@@ -197,10 +353,8 @@ static void generateStatementCode(TreeNode* node) {
 			emitComment("repeat: jump after body comes back here");
 
 			// Condition
-			savedLocation1 = emitSkip(0);
-			if (node->child[0]) {
-				cGen(node->child[0]);
-			}
+			savedLocation1      = emitSkip(0);
+			const char* endJump = generateCondition(node->child[0]);
 
 			// Body
 			savedLocation2 = emitSkip(1);
@@ -211,7 +365,7 @@ static void generateStatementCode(TreeNode* node) {
 			emitRM_Abs("LDA", PROGRAM_COUNTER, savedLocation1, "jump back to body");
 			savedLocation1 = emitSkip(0);
 			emitBackup(savedLocation2);
-			emitRM_Abs("JEQ", ACCUMULATOR, savedLocation1, "repeat: jmp to end");
+			emitRM_Abs(endJump, ACCUMULATOR, savedLocation1, "repeat: jmp to end");
 
 			emitRestore();
 			emitComment("<- while");
@@ -229,35 +383,29 @@ static void generateExpressionCode(TreeNode* node) {
 		case OpK: {
 			emitComment("-> Op");
 
-			if (node->child[0]) {
-				cGen(node->child[0]);
-			}
-			emitRM("ST", ACCUMULATOR, tmpOffset--, FRAME_POINTER, "op: push left");
-
-			if (node->child[1]) {
-				cGen(node->child[1]);
-			}
-			emitRM("LD", ACCUMULATOR_1, ++tmpOffset, FRAME_POINTER, "op: load left");
+			// Registers holding the operands when the operator runs
+			int left, right;
+			generateOperands(node, &left, &right);
 
 			switch (node->attr.op) {
 				case PLUS: {
-					emitRO("ADD", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op +");
+					emitRO("ADD", ACCUMULATOR, left, right, "op +");
 					break;
 				}
 				case MINUS: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op -");
+					emitRO("SUB", ACCUMULATOR, left, right, "op -");
 					break;
 				}
 				case TIMES: {
-					emitRO("MUL", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op *");
+					emitRO("MUL", ACCUMULATOR, left, right, "op *");
 					break;
 				}
 				case OVER: {
-					emitRO("DIV", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op /");
+					emitRO("DIV", ACCUMULATOR, left, right, "op /");
 					break;
 				}
 				case LT: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op <");
+					emitRO("SUB", ACCUMULATOR, left, right, "op <");
 					emitRM("JLT", ACCUMULATOR, 2, PROGRAM_COUNTER, "br if true");
 					emitRM("LDC", ACCUMULATOR, 0, ACCUMULATOR, "false case");
 					emitRM("LDA", PROGRAM_COUNTER, 1, PROGRAM_COUNTER, "unconditional jmp");
@@ -265,7 +413,7 @@ static void generateExpressionCode(TreeNode* node) {
 					break;
 				}
 				case LEQ: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op <=");
+					emitRO("SUB", ACCUMULATOR, left, right, "op <=");
 					emitRM("JLE", ACCUMULATOR, 2, PROGRAM_COUNTER, "br if true");
 					emitRM("LDC", ACCUMULATOR, 0, ACCUMULATOR, "false case");
 					emitRM("LDA", PROGRAM_COUNTER, 1, PROGRAM_COUNTER, "unconditional jmp");
@@ -273,7 +421,7 @@ static void generateExpressionCode(TreeNode* node) {
 					break;
 				}
 				case GT: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op >");
+					emitRO("SUB", ACCUMULATOR, left, right, "op >");
 					emitRM("JGT", ACCUMULATOR, 2, PROGRAM_COUNTER, "br if true");
 					emitRM("LDC", ACCUMULATOR, 0, ACCUMULATOR, "false case");
 					emitRM("LDA", PROGRAM_COUNTER, 1, PROGRAM_COUNTER, "unconditional jmp");
@@ -281,7 +429,7 @@ static void generateExpressionCode(TreeNode* node) {
 					break;
 				}
 				case GEQ: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op >=");
+					emitRO("SUB", ACCUMULATOR, left, right, "op >=");
 					emitRM("JGE", ACCUMULATOR, 2, PROGRAM_COUNTER, "br if true");
 					emitRM("LDC", ACCUMULATOR, 0, ACCUMULATOR, "false case");
 					emitRM("LDA", PROGRAM_COUNTER, 1, PROGRAM_COUNTER, "unconditional jmp");
@@ -289,7 +437,7 @@ static void generateExpressionCode(TreeNode* node) {
 					break;
 				}
 				case EQ: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op ==");
+					emitRO("SUB", ACCUMULATOR, left, right, "op ==");
 					emitRM("JEQ", ACCUMULATOR, 2, PROGRAM_COUNTER, "br if true");
 					emitRM("LDC", ACCUMULATOR, 0, ACCUMULATOR, "false case");
 					emitRM("LDA", PROGRAM_COUNTER, 1, PROGRAM_COUNTER, "unconditional jmp");
@@ -297,7 +445,7 @@ static void generateExpressionCode(TreeNode* node) {
 					break;
 				}
 				case NEQ: {
-					emitRO("SUB", ACCUMULATOR, ACCUMULATOR_1, ACCUMULATOR, "op !=");
+					emitRO("SUB", ACCUMULATOR, left, right, "op !=");
 					emitRM("JNE", ACCUMULATOR, 2, PROGRAM_COUNTER, "br if true");
 					emitRM("LDC", ACCUMULATOR, 0, ACCUMULATOR, "false case");
 					emitRM("LDA", PROGRAM_COUNTER, 1, PROGRAM_COUNTER, "unconditional jmp");
@@ -321,11 +469,11 @@ static void generateExpressionCode(TreeNode* node) {
 				emitComment("-> Vector");
 				// Global array
 				if (strcmp(symbol->scope, "global") == 0) {
-					emitRM("LDC", GLOBAL_POINTER, 0, 0, "load 0");
+					loadGlobalPointer();
 					emitRM("LD", ACCUMULATOR, symbol->memoryLocation, GLOBAL_POINTER,
 					       "get the address of the vector");
 				} else { // Local array
-					emitRM("LD", ACCUMULATOR, symbol->memoryLocation - MAX_MEMORY, FRAME_POINTER,
+					emitRM("LD", ACCUMULATOR, symbol->memoryLocation - MaxMemory, FRAME_POINTER,
 					       "get the address of the vector");
 				}
 
@@ -337,13 +485,12 @@ static void generateExpressionCode(TreeNode* node) {
 				} else {
 					symbol     = symbolTableLookupFromScope(node->child[0]->attr.name,
 					                                        node->child[0]->scope);
-					arrayIndex = symbol->memoryLocation - MAX_MEMORY;
+					arrayIndex = symbol->memoryLocation - MaxMemory;
 					emitRM("LD", INDEX_POINTER, arrayIndex, FRAME_POINTER,
 					       "get the value of the index");
 				}
 
-				emitRM("LDC", ACCUMULATOR_2, 1, 0, "load 1");
-				emitRO("ADD", INDEX_POINTER, INDEX_POINTER, ACCUMULATOR_2, "sub 3 by 1");
+				incrementIndex();
 				emitRO("SUB", ACCUMULATOR, ACCUMULATOR, INDEX_POINTER, "get the address");
 				emitRM("LD", ACCUMULATOR, 0, ACCUMULATOR, "get the value of the vector");
 
@@ -352,10 +499,10 @@ static void generateExpressionCode(TreeNode* node) {
 			}
 
 			if (strcmp(symbol->scope, "global") == 0) {
-				emitRM("LDC", GLOBAL_POINTER, 0, 0, "load 0");
+				loadGlobalPointer();
 				emitRM("LD", ACCUMULATOR, symbol->memoryLocation, GLOBAL_POINTER, "load id value");
 			} else {
-				emitRM("LD", ACCUMULATOR, symbol->memoryLocation - MAX_MEMORY, FRAME_POINTER,
+				emitRM("LD", ACCUMULATOR, symbol->memoryLocation - MaxMemory, FRAME_POINTER,
 				       "load id value");
 			}
 
@@ -390,7 +537,7 @@ static void generateExpressionCode(TreeNode* node) {
 
 				emitRM("LDA", FRAME_POINTER, tmpOffset, FRAME_POINTER, "change fp");
 				int savedLocation = emitSkip(0);
-				emitRM("LDC", ACCUMULATOR, savedLocation + 2, 0, "load return address");
+				emitLoadLocation(ACCUMULATOR, savedLocation + 2, "load return address");
 				emitRM_Abs("LDA", PROGRAM_COUNTER, lookup(node->attr.name), "jump to function");
 
 				emitComment("<- Function Call");
@@ -409,11 +556,11 @@ static void generateExpressionCode(TreeNode* node) {
 				symbol =
 				    symbolTableLookupFromScope(node->child[0]->attr.name, node->child[0]->scope);
 				if (strcmp(symbol->scope, "global") == 0) {
-					emitRM("LDC", GLOBAL_POINTER, 0, 0, "load 0");
+					loadGlobalPointer();
 					emitRM("LD", ACCUMULATOR_1, symbol->memoryLocation, GLOBAL_POINTER,
 					       "get the address of the vector");
 				} else {
-					emitRM("LD", ACCUMULATOR_1, symbol->memoryLocation - MAX_MEMORY, FRAME_POINTER,
+					emitRM("LD", ACCUMULATOR_1, symbol->memoryLocation - MaxMemory, FRAME_POINTER,
 					       "get the address of the vector");
 				}
 
@@ -423,12 +570,11 @@ static void generateExpressionCode(TreeNode* node) {
 					emitRM("LDC", INDEX_POINTER, tmp->attr.val, 0, "load array index");
 				} else {
 					symbol = symbolTableLookupFromScope(tmp->attr.name, tmp->scope);
-					emitRM("LD", INDEX_POINTER, symbol->memoryLocation - MAX_MEMORY, FRAME_POINTER,
+					emitRM("LD", INDEX_POINTER, symbol->memoryLocation - MaxMemory, FRAME_POINTER,
 					       "load array index");
 				}
 
-				emitRM("LDC", ACCUMULATOR_2, 1, 0, "load 1");
-				emitRO("ADD", INDEX_POINTER, INDEX_POINTER, ACCUMULATOR_2, "sub 3 by 1");
+				incrementIndex();
 				emitRO("SUB", ACCUMULATOR_1, ACCUMULATOR_1, INDEX_POINTER, "get the address");
 				emitRM("ST", ACCUMULATOR, 0, ACCUMULATOR_1, "get the value of the vector");
 
@@ -442,7 +588,7 @@ static void generateExpressionCode(TreeNode* node) {
 			if (node->child[1]) cGen(node->child[1]);
 
 			symbol = symbolTableLookupFromScope(node->child[0]->attr.name, node->child[0]->scope);
-			emitRM("ST", ACCUMULATOR, symbol->memoryLocation - MAX_MEMORY, FRAME_POINTER,
+			emitRM("ST", ACCUMULATOR, symbol->memoryLocation - MaxMemory, FRAME_POINTER,
 			       "store value");
 
 			emitComment("<- assign");
@@ -474,6 +620,7 @@ static void generateExpressionCode(TreeNode* node) {
 
 static void cGen(TreeNode* tree) {
 	if (tree) {
+		const int outerLine = emitSourceLine(tree->lineno);
 		switch (tree->nodekind) {
 			case StmtK:
 				generateStatementCode(tree);
@@ -484,10 +631,20 @@ static void cGen(TreeNode* tree) {
 			default:
 				break;
 		}
+		emitSourceLine(outerLine);
 		if (!areParametersFromFunctionCall) cGen(tree->sibling);
 	}
 }
 
+/**
+ * Whether the top-level declarations include a global variable, which the prelude's gp load serves.
+ */
+static bool declaresGlobal(TreeNode* syntaxTree) {
+	for (TreeNode* node = syntaxTree; node; node = node->sibling)
+		if ((node->nodekind == StmtK) && (node->kind.stmt == VarK)) return TRUE;
+	return FALSE;
+}
+
 void generateCode(TreeNode* syntaxTree) {
 	emitComment("TINY Compilation to TM Code");
 
@@ -495,6 +652,8 @@ void generateCode(TreeNode* syntaxTree) {
 	emitRM("LD", MEMORY_POINTER, 0, 0, "load maxaddress from location 0");
 	emitRM("LD", FRAME_POINTER, 0, 0, "load maxaddress from location 0");
 	emitRM("ST", ACCUMULATOR, 0, 0, "clear location 0");
+	if (AllocateRegisters && declaresGlobal(syntaxTree))
+		emitRM("LDC", GLOBAL_POINTER, 0, 0, "load 0 into gp for good");
 	emitComment("End of standard prelude.");
 
 	currentScopeName = "global";
@@ -502,4 +661,7 @@ void generateCode(TreeNode* syntaxTree) {
 
 	emitComment("End of execution.");
 	emitRO("HALT", 0, 0, 0, "");
+
+	if (Optimize) optimizeCode();
+	writeCode();
 }
@@ -1,5 +1,61 @@
 #include "code.h"
 #include "globals.h"
+#include "tmo.h"
+
+/**
+ * @brief All registers but the pc, as a register mask.
+ */
+#define ALL_REGISTERS 0x7F
+
+/**
+ * @brief The register mask of a register; the pc is in none.
+ */
+#define REGISTER(r) ((r) >= 0 && (r) < PROGRAM_COUNTER ? 1 << (r) : 0)
+
+/**
+ * @brief Most instructions between a push and its pop that optimizeCode looks through.
+ */
+#define PEEPHOLE_WINDOW 8
+
+/**
+ * @brief Indexes into TMO_OPCODES.
+ */
+typedef enum {
+	opHALT, opIN, opOUT, opADD, opSUB, opMUL, opDIV, opRRLim,
+	opLD, opST, opRMLim,
+	opLDA, opLDC, opJLT, opJLE, opJGT, opJGE, opJEQ, opJNE, opRALim
+} OpCode;
+
+/**
+ * @brief An emitted instruction.
+ */
+typedef struct {
+	TmoInstruction instruction; /**< Opcode and operands, as written to the object file. */
+	int            comment;     /**< Offset of the comment in codeText. */
+	int            line;        /**< Source line the instruction was generated for. */
+	bool           temporary;   /**< A push or pop of an expression temporary. */
+	bool           location;    /**< An LDC of a code location, relocated by optimizeCode. */
+	bool           deleted;     /**< Removed by optimizeCode. */
+} CodeRecord;
+
+/**
+ * @brief What optimizeCode knows about the instruction at a TM location.
+ */
+typedef struct {
+	int references;             /**< Jumps, return addresses and entry points to the location. */
+	int liveIn;                 /**< Registers that may be read before they are written. */
+	int liveOut;                /**< The same after the instruction. */
+	int known;                  /**< Registers whose value before the instruction is known. */
+	int value[PROGRAM_COUNTER]; /**< Their values. */
+} CodeFacts;
+
+/**
+ * @brief A line of the code file: an instruction or a comment.
+ */
+typedef struct {
+	int location; /**< TM location of the instruction, or -1 for a comment line. */
+	int comment;  /**< Offset of the comment in codeText, for a comment line. */
+} CodeLine;
 
 /**
  * @brief TM location number for current instruction emission.
@@ -13,32 +69,193 @@ static int emitLoc = 0;
  */
 static int highEmitLoc = 0;
 
+/**
+ * @brief Source line recorded with the instructions emitted.
+ */
+static int emitLine = 0;
+
+/**
+ * @brief Instructions emitted so far, indexed by TM location.
+ *
+ * Kept by location rather than in emission order so that backpatched instructions land in their
+ * final place. Locations skipped and never backpatched hold HALT 0,0,0.
+ */
+static CodeRecord* codeRecords = NULL;
+
+/**
+ * @brief Allocated size of codeRecords.
+ */
+static int codeSize = 0;
+
+/**
+ * @brief Lines of the code file in emission order.
+ *
+ * A backpatched instruction is written where it was emitted, after the code that follows its
+ * location, as the code file has always had it.
+ */
+static CodeLine* codeLines = NULL;
+
+/**
+ * @brief Number of entries in codeLines, and their allocated size.
+ */
+static int codeLineCount = 0, codeLinesSize = 0;
+
+/**
+ * @brief NUL terminated comments referenced by codeRecords and codeLines.
+ */
+static char* codeText = NULL;
+
+/**
+ * @brief Size in bytes of codeText, and its allocated size.
+ */
+static int codeTextLength = 0, codeTextSize = 0;
+
+/**
+ * @brief Facts about codeRecords, indexed by TM location, computed by analyzeCode.
+ */
+static CodeFacts* codeFacts = NULL;
+
+/**
+ * @brief Allocated size of codeFacts.
+ */
+static int codeFactsSize = 0;
+
+/**
+ * @brief Registers that some instruction not deleted reads, computed by analyzeCode.
+ */
+static int codeReads = 0;
+
+/**
+ * @brief Registers that every write sets to 0, computed by analyzeCode. The TM starts with all
+ * registers 0, so these are 0 everywhere.
+ */
+static int codeZero = 0;
+
+/**
+ * @brief Function entry points recorded by emitSymbol.
+ */
+static TmoSymbol* objectSymbols = NULL;
+
+/**
+ * @brief Number of entries in objectSymbols.
+ */
+static int objectSymbolCount = 0;
+
+/**
+ * @brief Symbol name table referenced by objectSymbols.
+ */
+static char* objectStrings = NULL;
+
+/**
+ * @brief Size in bytes of objectStrings.
+ */
+static int objectStringSize = 0;
+
+/**
+ * @brief Grows an array to hold at least count elements, doubling its size.
+ *
+ * @param array The array.
+ * @param size The allocated number of elements, updated.
+ * @param count The number of elements needed.
+ * @param elementSize The size of an element.
+ * @return The array, whose new elements are zeroed.
+ */
+static void* reserve(void* array, int* size, const int count, const size_t elementSize) {
+	if (count <= *size) return array;
+
+	int newSize = *size ? *size : 1024;
+	while (newSize < count) newSize *= 2;
+	char* grown = realloc(array, newSize * elementSize);
+	if (!grown) {
+		fprintf(stderr, "Out of memory generating code\n");
+		exit(1);
+	}
+	memset(grown + *size * elementSize, 0, (newSize - *size) * elementSize);
+	*size = newSize;
+	return grown;
+}
+
+/**
+ * @brief Copies a comment into codeText.
+ *
+ * @param comment The comment.
+ * @return Its offset in codeText.
+ */
+static int saveComment(const char* comment) {
+	const int offset = codeTextLength;
+	const int length = strlen(comment) + 1;
+
+	codeText = reserve(codeText, &codeTextSize, codeTextLength + length, 1);
+	memcpy(codeText + offset, comment, length);
+	codeTextLength += length;
+	return offset;
+}
+
+/**
+ * @brief Appends a line to the code file.
+ *
+ * @param location The TM location of the instruction, or -1 for a comment line.
+ * @param comment The offset of the comment of a comment line.
+ */
+static void addLine(const int location, const int comment) {
+	codeLines = reserve(codeLines, &codeLinesSize, codeLineCount + 1, sizeof(CodeLine));
+	codeLines[codeLineCount++] = (CodeLine){location, comment};
+}
+
+/**
+ * @brief Records an instruction at the current emission location and advances it.
+ *
+ * @param opcode The opcode of the instruction.
+ * @param arg1 The target register.
+ * @param arg2 The second operand (source register or offset).
+ * @param arg3 The third operand (source register or base register).
+ * @param comment The comment of the instruction.
+ */
+static void emitInstruction(const char* opcode, const int arg1, const int arg2, const int arg3,
+                            const char* comment) {
+	static const char* const opcodes[TMO_OPCODE_COUNT] = TMO_OPCODES;
+
+	codeRecords = reserve(codeRecords, &codeSize, emitLoc + 1, sizeof(CodeRecord));
+
+	int op = 0;
+	while (op < TMO_OPCODE_COUNT && strcmp(opcodes[op], opcode) != 0) op++;
+	codeRecords[emitLoc] =
+	    (CodeRecord){{op, arg1, arg2, arg3}, saveComment(comment), emitLine, FALSE, FALSE, FALSE};
+	addLine(emitLoc++, 0);
+	if (highEmitLoc < emitLoc) highEmitLoc = emitLoc;
+}
+
 void emitComment(char* comment) {
-	if (TraceCode) pc("* %s\n", comment);
+	addLine(-1, saveComment(comment));
 }
 
-void emitRO(char* opcode, const int targetReg, const int srcReg1, const int srcReg2,
+void emitRO(const char* opcode, const int targetReg, const int srcReg1, const int srcReg2,
             char* comment) {
-	pc("%3d:  %5s  %d,%d,%d ", emitLoc++, opcode, targetReg, srcReg1, srcReg2);
-	if (TraceCode) pc("\t%s", comment);
-	pc("\n");
-	if (highEmitLoc < emitLoc) highEmitLoc = emitLoc;
+	emitInstruction(opcode, targetReg, srcReg1, srcReg2, comment);
 }
 
-void emitRM(char* opcode, const int targetReg, const int offset, const int baseReg, char* comment) {
-	pc("%3d:  %5s  %d,%d(%d) ", emitLoc++, opcode, targetReg, offset, baseReg);
-	if (TraceCode) pc("\t%s", comment);
-	pc("\n");
-	if (highEmitLoc < emitLoc) highEmitLoc = emitLoc;
+void emitRM(const char* opcode, const int targetReg, const int offset, const int baseReg,
+            char* comment) {
+	emitInstruction(opcode, targetReg, offset, baseReg, comment);
 }
 
-void emitRM_Abs(char* opcode, const int targetReg, const int absLocation, char* comment) {
-	pc("%3d:  %5s  %d,%d(%d) ", emitLoc, opcode, targetReg, absLocation - (emitLoc + 1),
-	   PROGRAM_COUNTER);
-	++emitLoc;
-	if (TraceCode) pc("\t%s", comment);
-	pc("\n");
-	if (highEmitLoc < emitLoc) highEmitLoc = emitLoc;
+void emitRM_Abs(const char* opcode, const int targetReg, const int absLocation, char* comment) {
+	emitInstruction(opcode, targetReg, absLocation - (emitLoc + 1), PROGRAM_COUNTER, comment);
+}
+
+void emitPush(const int reg, const int offset, char* comment) {
+	emitInstruction("ST", reg, offset, FRAME_POINTER, comment);
+	codeRecords[emitLoc - 1].temporary = TRUE;
+}
+
+void emitPop(const int reg, const int offset, char* comment) {
+	emitInstruction("LD", reg, offset, FRAME_POINTER, comment);
+	codeRecords[emitLoc - 1].temporary = TRUE;
+}
+
+void emitLoadLocation(const int targetReg, const int location, char* comment) {
+	emitInstruction("LDC", targetReg, location, 0, comment);
+	codeRecords[emitLoc - 1].location = TRUE;
 }
 
 int emitSkip(const int howMany) {
@@ -56,3 +273,582 @@ void emitBackup(const int location) {
 void emitRestore(void) {
 	emitLoc = highEmitLoc;
 }
+
+int emitSourceLine(const int line) {
+	const int previous = emitLine;
+	emitLine           = line;
+	return previous;
+}
+
+void emitSymbol(const char* name, const int location, const int line) {
+	const int length = strlen(name) + 1;
+
+	objectSymbols = realloc(objectSymbols, (objectSymbolCount + 1) * sizeof(TmoSymbol));
+	objectSymbols[objectSymbolCount++] = (TmoSymbol){location, line, objectStringSize};
+
+	objectStrings = realloc(objectStrings, objectStringSize + length);
+	memcpy(objectStrings + objectStringSize, name, length);
+	objectStringSize += length;
+}
+
+/**
+ * @brief Registers an instruction reads.
+ */
+static int uses(const TmoInstruction* in) {
+	switch (in->op) {
+		case opOUT:
+			return REGISTER(in->arg1);
+		case opADD:
+		case opSUB:
+		case opMUL:
+		case opDIV:
+			return REGISTER(in->arg2) | REGISTER(in->arg3);
+		case opLD:
+		case opLDA:
+			return REGISTER(in->arg3);
+		case opST:
+		case opJLT:
+		case opJLE:
+		case opJGT:
+		case opJGE:
+		case opJEQ:
+		case opJNE:
+			return REGISTER(in->arg1) | REGISTER(in->arg3);
+		default:
+			return 0;
+	}
+}
+
+/**
+ * @brief Whether an instruction writes its first operand.
+ */
+static bool writesTarget(const TmoInstruction* in) {
+	switch (in->op) {
+		case opIN:
+		case opADD:
+		case opSUB:
+		case opMUL:
+		case opDIV:
+		case opLD:
+		case opLDA:
+		case opLDC:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * @brief Registers an instruction writes.
+ */
+static int defines(const TmoInstruction* in) {
+	return writesTarget(in) ? REGISTER(in->arg1) : 0;
+}
+
+/**
+ * @brief Whether an instruction is a conditional jump.
+ */
+static bool isBranch(const TmoInstruction* in) {
+	return in->op >= opJLT && in->op <= opJNE;
+}
+
+/**
+ * @brief Whether an instruction may write the pc.
+ */
+static bool writesPc(const TmoInstruction* in) {
+	return isBranch(in) || (writesTarget(in) && in->arg1 == PROGRAM_COUNTER);
+}
+
+/**
+ * @brief Whether an instruction is an unconditional jump relative to the pc.
+ */
+static bool isJump(const TmoInstruction* in) {
+	return in->op == opLDA && in->arg1 == PROGRAM_COUNTER && in->arg3 == PROGRAM_COUNTER;
+}
+
+/**
+ * @brief The TM location an instruction at a location jumps to relative to the pc.
+ *
+ * @return The location, or -1 if the instruction is no such jump.
+ */
+static int jumpTarget(const int location) {
+	const TmoInstruction* in = &codeRecords[location].instruction;
+	if (isJump(in) || (isBranch(in) && in->arg3 == PROGRAM_COUNTER))
+		return location + 1 + in->arg2;
+	return -1;
+}
+
+/**
+ * @brief The first location from a location on whose instruction was not deleted.
+ */
+static int resolve(int location) {
+	while (location < highEmitLoc && codeRecords[location].deleted) location++;
+	return location;
+}
+
+/**
+ * @brief The location of the instruction before the one at a location, or -1.
+ */
+static int previous(int location) {
+	do location--;
+	while (location >= 0 && codeRecords[location].deleted);
+	return location;
+}
+
+/**
+ * @brief Adds count references to a location.
+ */
+static void addReference(const int location, const int count) {
+	if (location >= 0 && location <= highEmitLoc) codeFacts[location].references += count;
+}
+
+/**
+ * @brief Adds count times the references that the instruction at a location makes.
+ */
+static void addReferences(const int location, const int count) {
+	addReference(jumpTarget(location), count);
+	if (codeRecords[location].location) addReference(codeRecords[location].instruction.arg2, count);
+}
+
+/**
+ * @brief References leading to the instruction at a location, including those to the deleted
+ * instructions just before it.
+ */
+static int referencesTo(int location) {
+	int count = codeFacts[location].references;
+	while (--location >= 0 && codeRecords[location].deleted)
+		count += codeFacts[location].references;
+	return count;
+}
+
+/**
+ * @brief Deletes the instruction at a location and the references it makes.
+ */
+static void deleteRecord(const int location) {
+	addReferences(location, -1);
+	codeRecords[location].deleted = TRUE;
+}
+
+/**
+ * @brief Registers that may be read after the instruction at a location.
+ */
+static int liveOut(const int location) {
+	const TmoInstruction* in     = &codeRecords[location].instruction;
+	const int             target = jumpTarget(location);
+	const int             next   = codeFacts[location + 1].liveIn;
+
+	if (in->op == opHALT) return 0;
+	if (target >= 0) {
+		if (target > highEmitLoc) return codeReads;
+		return codeFacts[target].liveIn | (isBranch(in) ? next : 0);
+	}
+	if (writesPc(in)) return codeReads; /* a return, to wherever its caller is */
+	return next;
+}
+
+/**
+ * @brief Tracks known register values from one instruction to the next, starting with those
+ * recorded before a location, and records them in codeFacts. Values are forgotten at every
+ * location jumped to, except for codeZero. Stops past a last location once the values agree with
+ * those recorded already.
+ */
+static void propagateKnown(int location, const int last) {
+	int known = codeFacts[location].known, value[PROGRAM_COUNTER];
+	memcpy(value, codeFacts[location].value, sizeof(value));
+
+	for (; location < highEmitLoc; location++) {
+		CodeFacts*            facts = &codeFacts[location];
+		const TmoInstruction* in    = &codeRecords[location].instruction;
+		if (facts->references > 0) {
+			known = codeZero;
+			memset(value, 0, sizeof(value));
+		}
+		if (location > last && facts->known == known) {
+			int r = 0;
+			while (r < PROGRAM_COUNTER && (!(known & REGISTER(r)) || facts->value[r] == value[r]))
+				r++;
+			if (r == PROGRAM_COUNTER) return;
+		}
+		facts->known = known;
+		memcpy(facts->value, value, sizeof(value));
+		if (codeRecords[location].deleted) continue;
+
+		const int r = in->arg1;
+		if (in->op == opLDA && (known & REGISTER(in->arg3)) && r != PROGRAM_COUNTER) {
+			value[r] = value[in->arg3] + in->arg2;
+			known |= REGISTER(r);
+		} else if (in->op == opLDC && r != PROGRAM_COUNTER && !codeRecords[location].location) {
+			value[r] = in->arg2;
+			known |= REGISTER(r);
+		} else
+			known &= ~defines(in);
+	}
+}
+
+/**
+ * @brief Computes codeFacts for the code not deleted.
+ *
+ * Liveness is solved over the whole program, a computed jump leaving every register that is read
+ * anywhere live. Known register values are found by propagateKnown.
+ */
+static void analyzeCode(void) {
+	codeFacts = reserve(codeFacts, &codeFactsSize, highEmitLoc + 1, sizeof(CodeFacts));
+	memset(codeFacts, 0, (highEmitLoc + 1) * sizeof(CodeFacts));
+
+	codeZero  = ALL_REGISTERS;
+	codeReads = 0;
+	addReference(0, 1);
+	for (int i = 0; i < objectSymbolCount; i++) addReference(objectSymbols[i].loc, 1);
+	for (int loc = 0; loc < highEmitLoc; loc++) {
+		const CodeRecord* record = &codeRecords[loc];
+		if (record->deleted) continue;
+		codeReads |= uses(&record->instruction);
+		addReferences(loc, 1);
+		if (record->instruction.op != opLDC || record->instruction.arg2 != 0 || record->location)
+			codeZero &= ~defines(&record->instruction);
+	}
+
+	bool changed = TRUE;
+	while (changed) {
+		changed = FALSE;
+		for (int loc = highEmitLoc - 1; loc >= 0; loc--) {
+			CodeFacts*            facts = &codeFacts[loc];
+			const TmoInstruction* in    = &codeRecords[loc].instruction;
+			int                   out, live;
+			if (codeRecords[loc].deleted)
+				out = live = codeFacts[loc + 1].liveIn;
+			else {
+				out  = liveOut(loc);
+				live = uses(in) | (out & ~defines(in));
+			}
+			changed |= live != facts->liveIn || out != facts->liveOut;
+			facts->liveIn  = live;
+			facts->liveOut = out;
+		}
+	}
+
+	codeFacts[0].known = codeZero;
+	propagateKnown(0, highEmitLoc);
+}
+
+/**
+ * @brief Removes an LDC of the value its register is known to have.
+ */
+static bool removeKnownLoad(const int location) {
+	CodeRecord*      record = &codeRecords[location];
+	const CodeFacts* facts  = &codeFacts[location];
+	const int        r      = record->instruction.arg1;
+
+	if (record->instruction.op != opLDC || record->location || !(facts->known & REGISTER(r)) ||
+	    facts->value[r] != record->instruction.arg2)
+		return FALSE;
+	deleteRecord(location);
+	return TRUE;
+}
+
+/**
+ * @brief Turns an ADD or SUB with an operand of known value into an LDA of the other operand.
+ */
+static bool foldKnownOperand(const int location) {
+	TmoInstruction*  in    = &codeRecords[location].instruction;
+	const CodeFacts* facts = &codeFacts[location];
+	const int        s = in->arg2, t = in->arg3;
+
+	if ((in->op != opADD && in->op != opSUB) || in->arg1 == PROGRAM_COUNTER ||
+	    s == PROGRAM_COUNTER || t == PROGRAM_COUNTER)
+		return FALSE;
+	if (facts->known & REGISTER(t)) {
+		const int value = in->op == opADD ? facts->value[t] : -facts->value[t];
+		*in             = (TmoInstruction){opLDA, in->arg1, value, s};
+	} else if (in->op == opADD && (facts->known & REGISTER(s))) {
+		*in = (TmoInstruction){opLDA, in->arg1, facts->value[s], t};
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * @brief Keeps an expression temporary in the register it is popped to.
+ *
+ * A push, the instructions up to its pop and the pop become a move to the pop's register
+ * followed by those instructions, provided that they do not jump, store, or touch that register,
+ * the frame pointer or the temporary, and that nothing jumps into them.
+ */
+static bool keepTemporary(const int location) {
+	CodeRecord*           push = &codeRecords[location];
+	const TmoInstruction* in   = &push->instruction;
+	const int             base = in->arg3, offset = in->arg2;
+	int                   touched = 0;
+
+	if (!push->temporary || in->op != opST) return FALSE;
+	int next = resolve(location + 1);
+	for (int n = 0; n < PEEPHOLE_WINDOW && next < highEmitLoc; n++) {
+		const CodeRecord*     record = &codeRecords[next];
+		const TmoInstruction* x      = &record->instruction;
+		if (referencesTo(next) > 0) return FALSE;
+		if (x->op == opLD && x->arg3 == base && x->arg2 == offset) {
+			if (!record->temporary || (touched & REGISTER(x->arg1))) return FALSE;
+			push->instruction         = (TmoInstruction){opLDA, x->arg1, 0, in->arg1};
+			push->temporary           = FALSE;
+			push->comment             = saveComment("op: keep left in a register");
+			deleteRecord(next);
+			return TRUE;
+		}
+		if (writesPc(x) || x->op == opST || x->op == opHALT || (defines(x) & REGISTER(base)))
+			return FALSE;
+		touched |= uses(x) | defines(x);
+		next = resolve(next + 1);
+	}
+	return FALSE;
+}
+
+/**
+ * @brief Turns a load of the location just stored to into a move from the register stored.
+ */
+static bool removeReload(const int location) {
+	CodeRecord*           load = &codeRecords[location];
+	const TmoInstruction* in   = &load->instruction;
+	const int             prev = previous(location);
+
+	if (in->op != opLD || load->temporary || prev < 0 || referencesTo(location) > 0) return FALSE;
+
+	const TmoInstruction* store = &codeRecords[prev].instruction;
+	if (store->op != opST || store->arg2 != in->arg2 || store->arg3 != in->arg3) return FALSE;
+	if (in->arg1 == store->arg1)
+		deleteRecord(location);
+	else
+		load->instruction = (TmoInstruction){opLDA, in->arg1, 0, store->arg1};
+	return TRUE;
+}
+
+/**
+ * @brief Makes the instruction before a register move write the move's destination instead.
+ */
+static bool foldMove(const int location) {
+	const TmoInstruction* in   = &codeRecords[location].instruction;
+	const int             prev = previous(location);
+
+	if (in->op != opLDA || in->arg2 != 0 || in->arg1 == in->arg3 || !REGISTER(in->arg1) ||
+	    !REGISTER(in->arg3) || prev < 0 || referencesTo(location) > 0 ||
+	    (codeFacts[location].liveOut & REGISTER(in->arg3)))
+		return FALSE;
+
+	TmoInstruction* def = &codeRecords[prev].instruction;
+	if (defines(def) != REGISTER(in->arg3) || codeRecords[prev].location) return FALSE;
+	def->arg1 = in->arg1;
+	deleteRecord(location);
+	return TRUE;
+}
+
+/**
+ * @brief Removes the unconditional jump from the code of a relational operator.
+ *
+ * "r = x; Jcc r,2(7); LDC r,f; LDA 7,1(7); LDC r,t" becomes "s = x; LDC r,t; Jcc s,1(7); LDC r,f"
+ * with a register s that is dead after it.
+ */
+static bool removeSkip(const int location) {
+	TmoInstruction* def = &codeRecords[location].instruction;
+	const int       r   = def->arg1;
+	int             at[4], s;
+
+	at[0] = resolve(location + 1);
+	for (int i = 1; i < 4; i++) at[i] = resolve(at[i - 1] + 1);
+	if (at[3] >= highEmitLoc || defines(def) != REGISTER(r) || codeRecords[location].location)
+		return FALSE;
+
+	const TmoInstruction* branch    = &codeRecords[at[0]].instruction;
+	const TmoInstruction* falseCase = &codeRecords[at[1]].instruction;
+	const TmoInstruction* skip      = &codeRecords[at[2]].instruction;
+	const TmoInstruction* trueCase  = &codeRecords[at[3]].instruction;
+	if (!isBranch(branch) || branch->arg1 != r || resolve(jumpTarget(at[0])) != at[3] ||
+	    falseCase->op != opLDC || falseCase->arg1 != r || !isJump(skip) ||
+	    resolve(jumpTarget(at[2])) != resolve(at[3] + 1) || trueCase->op != opLDC ||
+	    trueCase->arg1 != r || referencesTo(at[0]) > 0 || referencesTo(at[1]) > 0 ||
+	    referencesTo(at[2]) > 0 || referencesTo(at[3]) != 1)
+		return FALSE;
+	/* s must not be one of codeZero either, which would not be 0 everywhere any more */
+	for (s = 0; s < PROGRAM_COUNTER; s++)
+		if (s != r && !((codeFacts[at[3]].liveOut | codeZero) & REGISTER(s))) break;
+	if (s == PROGRAM_COUNTER) return FALSE;
+
+	addReferences(at[0], -1);
+	addReferences(at[2], -1);
+	const CodeRecord branchRecord = codeRecords[at[0]];
+	const CodeRecord falseRecord  = codeRecords[at[1]];
+	def->arg1                     = s;
+	codeRecords[at[0]]            = codeRecords[at[3]];
+	codeRecords[at[1]]            = branchRecord;
+	codeRecords[at[1]].instruction =
+	    (TmoInstruction){branchRecord.instruction.op, s, at[3] - (at[1] + 1), PROGRAM_COUNTER};
+	codeRecords[at[2]] = falseRecord;
+	addReferences(at[1], 1);
+	deleteRecord(at[3]);
+	return TRUE;
+}
+
+/**
+ * @brief Removes a jump to the next instruction, or makes a jump to a jump go where that one goes.
+ */
+static bool shortenJump(const int location) {
+	TmoInstruction* in     = &codeRecords[location].instruction;
+	const int       target = jumpTarget(location);
+
+	if (target < 0 || target > highEmitLoc) return FALSE;
+	const int to = resolve(target);
+	if (to == resolve(location + 1)) {
+		deleteRecord(location);
+		return TRUE;
+	}
+	if (to == location || to >= highEmitLoc || !isJump(&codeRecords[to].instruction)) return FALSE;
+	const int next = jumpTarget(to);
+	if (next < 0 || next > highEmitLoc || resolve(next) == to) return FALSE;
+	addReferences(location, -1);
+	in->arg2 = next - (location + 1);
+	addReferences(location, 1);
+	return TRUE;
+}
+
+/**
+ * @brief Removes an instruction that cannot fault and writes only a register that is dead, or
+ * moves a register to itself.
+ */
+static bool removeDeadDefinition(const int location) {
+	const TmoInstruction* in = &codeRecords[location].instruction;
+
+	if ((in->op != opLDC && in->op != opLDA && in->op != opADD && in->op != opSUB &&
+	     in->op != opMUL) ||
+	    !REGISTER(in->arg1))
+		return FALSE;
+	if ((codeFacts[location].liveOut & REGISTER(in->arg1)) &&
+	    (in->op != opLDA || in->arg2 != 0 || in->arg3 != in->arg1))
+		return FALSE;
+	deleteRecord(location);
+	return TRUE;
+}
+
+/**
+ * @brief Removes an instruction that nothing jumps to after one that always writes the pc.
+ */
+static bool removeUnreachable(const int location) {
+	const int prev = previous(location);
+
+	if (prev < 0 || referencesTo(location) > 0) return FALSE;
+	const TmoInstruction* in = &codeRecords[prev].instruction;
+	if (in->op != opHALT && (isBranch(in) || !writesPc(in))) return FALSE;
+	deleteRecord(location);
+	return TRUE;
+}
+
+/**
+ * @brief Drops the deleted instructions, moving the others up and adjusting every jump, return
+ * address and entry point to the new locations.
+ */
+static void relocateCode(void) {
+	int  size        = 0;
+	int* newLocation = reserve(NULL, &size, highEmitLoc + 1, sizeof(int));
+	int  count       = 0;
+
+	for (int loc = 0; loc <= highEmitLoc; loc++) {
+		newLocation[loc] = count;
+		if (loc < highEmitLoc && !codeRecords[loc].deleted) count++;
+	}
+
+	int lines = 0;
+	for (int i = 0; i < codeLineCount; i++) {
+		const CodeLine line = codeLines[i];
+		if (line.location < 0)
+			codeLines[lines++] = line;
+		else if (!codeRecords[line.location].deleted)
+			codeLines[lines++] = (CodeLine){newLocation[line.location], line.comment};
+	}
+	codeLineCount = lines;
+
+	for (int loc = 0; loc < highEmitLoc; loc++) {
+		if (codeRecords[loc].deleted) continue;
+		TmoInstruction* in     = &codeRecords[loc].instruction;
+		const int       target = loc + 1 + in->arg2;
+		if (in->op > opRRLim && in->op != opLDC && in->arg3 == PROGRAM_COUNTER && target >= 0 &&
+		    target <= highEmitLoc)
+			in->arg2 = newLocation[target] - (newLocation[loc] + 1);
+		if (codeRecords[loc].location && in->arg2 >= 0 && in->arg2 <= highEmitLoc)
+			in->arg2 = newLocation[in->arg2];
+		codeRecords[newLocation[loc]] = codeRecords[loc];
+	}
+
+	for (int i = 0; i < objectSymbolCount; i++)
+		if (objectSymbols[i].loc <= highEmitLoc)
+			objectSymbols[i].loc = newLocation[objectSymbols[i].loc];
+
+	emitLoc = highEmitLoc = count;
+	free(newLocation);
+}
+
+void optimizeCode(void) {
+	static bool (*const rules[])(int) = {removeKnownLoad, foldKnownOperand, keepTemporary,
+	                                     removeReload,    foldMove,         removeSkip,
+	                                     shortenJump,     removeDeadDefinition, removeUnreachable};
+
+	codeRecords = reserve(codeRecords, &codeSize, highEmitLoc + 1, sizeof(CodeRecord));
+
+	/* Facts are computed once per sweep. A rewrite can only make registers live in the window of
+	 * instructions it looked at, or before it, so the sweep goes on after that window; known
+	 * values are brought up to date from the instruction before it. */
+	bool changed = TRUE;
+	while (changed) {
+		changed = FALSE;
+		analyzeCode();
+		for (int loc = 0, end = 0; loc < highEmitLoc; loc++) {
+			if (loc < end || codeRecords[loc].deleted) continue;
+			for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++)
+				if (rules[i](loc)) {
+					end = loc;
+					for (int n = 0; n <= PEEPHOLE_WINDOW && end < highEmitLoc; n++)
+						end = resolve(end + 1);
+					propagateKnown(previous(loc) < 0 ? 0 : previous(loc), end);
+					changed = TRUE;
+					break;
+				}
+		}
+	}
+	relocateCode();
+}
+
+void writeCode(void) {
+	static const char* const opcodes[TMO_OPCODE_COUNT] = TMO_OPCODES;
+
+	for (int i = 0; i < codeLineCount; i++) {
+		const CodeLine* line = &codeLines[i];
+		if (line->location < 0) {
+			if (TraceCode) pc("* %s\n", codeText + line->comment);
+			continue;
+		}
+
+		const CodeRecord*     record = &codeRecords[line->location];
+		const TmoInstruction* in     = &record->instruction;
+		const char*           format = in->op < opRRLim ? "%3d:  %5s  %d,%d,%d %s%s\n"
+		                                                : "%3d:  %5s  %d,%d(%d) %s%s\n";
+		pc(format, line->location, opcodes[in->op], in->arg1, in->arg2, in->arg3,
+		   TraceCode ? "\t" : "", TraceCode ? codeText + record->comment : "");
+	}
+}
+
+bool writeObject(const char* fileName) {
+	FILE* file = fopen(fileName, "wb");
+	if (!file) return FALSE;
+
+	const TmoHeader header = {TMO_MAGIC,         TMO_VERSION,      highEmitLoc,
+	                          objectSymbolCount, objectStringSize, 0};
+
+	codeRecords = reserve(codeRecords, &codeSize, highEmitLoc, sizeof(CodeRecord));
+	bool ok     = fwrite(&header, sizeof(header), 1, file) == 1;
+	for (int loc = 0; ok && loc < highEmitLoc; loc++)
+		ok = fwrite(&codeRecords[loc].instruction, sizeof(TmoInstruction), 1, file) == 1;
+	if (ok && objectSymbolCount)
+		ok = fwrite(objectSymbols, sizeof(TmoSymbol), objectSymbolCount, file) ==
+		     (size_t)objectSymbolCount;
+	if (ok && objectStringSize)
+		ok = fwrite(objectStrings, 1, objectStringSize, file) == (size_t)objectStringSize;
+
+	return fclose(file) == 0 && ok;
+}
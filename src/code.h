@@ -1,6 +1,8 @@
 #ifndef _CODE_H_
 #define _CODE_H_
 
+#include <stdbool.h>
+
 /* Program counter register */
 #define PROGRAM_COUNTER 7
 
@@ -40,7 +42,7 @@ void emitComment(char* comment);
  * @param srcReg1 The first source register.
  * @param srcReg2 The second source register.
  */
-void emitRO(char* opcode, int targetReg, int srcReg1, int srcReg2, char* comment);
+void emitRO(const char* opcode, int targetReg, int srcReg1, int srcReg2, char* comment);
 
 /**
  * @brief Emits a register-to-memory TM instruction.
@@ -51,7 +53,7 @@ void emitRO(char* opcode, int targetReg, int srcReg1, int srcReg2, char* comment
  * @param baseReg The base register.
  * @param comment A comment to be printed if TraceCode is TRUE.
  */
-void emitRM(char* opcode, int targetReg, int offset, int baseReg, char* comment);
+void emitRM(const char* opcode, int targetReg, int offset, int baseReg, char* comment);
 
 /**
  * @brief Emits a register-to-memory TM instruction with an absolute reference.
@@ -61,7 +63,37 @@ void emitRM(char* opcode, int targetReg, int offset, int baseReg, char* comment)
  * @param absLocation The absolute location in memory.
  * @param comment A comment to be printed if TraceCode is TRUE.
  */
-void emitRM_Abs(char* opcode, int targetReg, int absLocation, char* comment);
+void emitRM_Abs(const char* opcode, int targetReg, int absLocation, char* comment);
+
+/**
+ * @brief Emits a push of a register to an expression temporary in the current frame.
+ *
+ * The temporary is read only by the matching emitPop, so the optimizer may keep the value in a
+ * register instead.
+ *
+ * @param reg The register pushed.
+ * @param offset The offset of the temporary from the frame pointer.
+ * @param comment A comment to be printed if TraceCode is TRUE.
+ */
+void emitPush(int reg, int offset, char* comment);
+
+/**
+ * @brief Emits the pop of an expression temporary pushed by emitPush.
+ *
+ * @param reg The register the temporary is loaded into.
+ * @param offset The offset of the temporary from the frame pointer.
+ * @param comment A comment to be printed if TraceCode is TRUE.
+ */
+void emitPop(int reg, int offset, char* comment);
+
+/**
+ * @brief Emits an LDC of a TM location, such as a return address, which the optimizer relocates.
+ *
+ * @param targetReg The target register.
+ * @param location The TM location loaded.
+ * @param comment A comment to be printed if TraceCode is TRUE.
+ */
+void emitLoadLocation(int targetReg, int location, char* comment);
 
 /**
  * @brief Skips a number of code locations for later backpatching.
@@ -83,4 +115,50 @@ void emitBackup(int location);
  */
 void emitRestore(void);
 
+/**
+ * @brief Sets the source line recorded with the instructions emitted from now on.
+ *
+ * @param line The source line.
+ * @return The source line set before.
+ */
+int emitSourceLine(int line);
+
+/**
+ * @brief Records a function entry point for the binary object file.
+ *
+ * @param name The function name.
+ * @param location The TM location of the first instruction of the function.
+ * @param line The source line of the declaration.
+ */
+void emitSymbol(const char* name, int location, int line);
+
+/**
+ * @brief Runs the peephole optimizer over the code emitted so far.
+ *
+ * Rewrites redundant instruction sequences (pushes and pops of expression temporaries, reloads
+ * of registers with known values, constant operands, the jump in relational operators, jumps to
+ * jumps and to the next instruction, writes of dead registers) and removes the instructions this
+ * leaves unused, moving the others up and adjusting jumps, return addresses and entry points.
+ * Must be called after the last instruction is emitted and backpatched.
+ */
+void optimizeCode(void);
+
+/**
+ * @brief Writes the code emitted so far as TM text to the code file.
+ *
+ * Instructions and comments are written in the order they were emitted, backpatched
+ * instructions where they were patched; comments only if TraceCode is TRUE.
+ */
+void writeCode(void);
+
+/**
+ * @brief Writes the code emitted so far as a binary TM object file (see tmo.h).
+ *
+ * Locations that were skipped and never backpatched are written as HALT 0,0,0.
+ *
+ * @param fileName The name of the object file.
+ * @return TRUE on success, FALSE if the file could not be written.
+ */
+bool writeObject(const char* fileName);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include "fold.h"
+#include "symtab.h"
+
+#include <limits.h>
+
+/**
+ * @brief Known value of a local variable.
+ */
+typedef struct {
+	BucketList symbol; /**< The variable. */
+	int        value;  /**< Its value. */
+} Constant;
+
+/**
+ * @brief Local variables whose value is known at a point of the program.
+ */
+typedef struct {
+	Constant* constants; /**< The variables and their values. */
+	int       count;     /**< Number of constants. */
+	int       size;      /**< Number of constants allocated. */
+} Constants;
+
+/**
+ * @brief Returns the constant of a variable, or NULL if its value is not known.
+ */
+static Constant* findConstant(const Constants* known, BucketList symbol) {
+	for (int i = 0; i < known->count; i++)
+		if (known->constants[i].symbol == symbol) return &known->constants[i];
+	return NULL;
+}
+
+/**
+ * @brief Records that a variable is not known any more.
+ */
+static void forgetConstant(Constants* known, BucketList symbol) {
+	Constant* constant = findConstant(known, symbol);
+	if (constant) *constant = known->constants[--known->count];
+}
+
+/**
+ * @brief Records the value of a variable.
+ */
+static void setConstant(Constants* known, BucketList symbol, int value) {
+	Constant* constant = findConstant(known, symbol);
+	if (!constant) {
+		if (known->count == known->size) {
+			known->size      = known->size ? 2 * known->size : 16;
+			known->constants = realloc(known->constants, known->size * sizeof(Constant));
+			if (!known->constants) {
+				fprintf(stderr, "Out of memory folding constants\n");
+				exit(1);
+			}
+		}
+		constant         = &known->constants[known->count++];
+		constant->symbol = symbol;
+	}
+	constant->value = value;
+}
+
+/**
+ * @brief Returns a copy of known, to be released with freeConstants.
+ */
+static Constants copyConstants(const Constants* known) {
+	Constants copy = {NULL, 0, 0};
+	for (int i = 0; i < known->count; i++)
+		setConstant(&copy, known->constants[i].symbol, known->constants[i].value);
+	return copy;
+}
+
+static void freeConstants(Constants* known) {
+	free(known->constants);
+	known->constants = NULL;
+	known->count = known->size = 0;
+}
+
+/**
+ * @brief Keeps in known only the variables that other knows to have the same value, where two
+ * paths of the program join.
+ */
+static void joinConstants(Constants* known, const Constants* other) {
+	for (int i = 0; i < known->count;) {
+		const Constant* constant = findConstant(other, known->constants[i].symbol);
+		if (constant && constant->value == known->constants[i].value)
+			i++;
+		else
+			known->constants[i] = known->constants[--known->count];
+	}
+}
+
+/**
+ * @brief Returns the symbol of a scalar variable read or written by an IdK node, or NULL.
+ */
+static BucketList scalarVariable(const TreeNode* node) {
+	if (!node || node->nodekind != ExpK || node->kind.exp != IdK || node->isArray) return NULL;
+	BucketList symbol = symbolTableLookupFromScope(node->attr.name, node->scope);
+	if (!symbol || symbol->isArray || symbol->kind == FuncK) return NULL;
+	return symbol;
+}
+
+/**
+ * @brief Returns the symbol of a local scalar variable, or NULL. Only these are propagated: a
+ * call cannot change them, as C- passes scalars by value.
+ */
+static BucketList localVariable(const TreeNode* node) {
+	BucketList symbol = scalarVariable(node);
+	if (!symbol || strcmp(symbol->scope, "global") == 0) return NULL;
+	return symbol;
+}
+
+/**
+ * @brief Forgets every local variable assigned anywhere in a tree and its siblings.
+ */
+static void forgetAssigned(const TreeNode* node, Constants* known) {
+	for (; node; node = node->sibling) {
+		if (node->nodekind == ExpK && node->kind.exp == AssignK) {
+			BucketList symbol = localVariable(node->child[0]);
+			if (symbol) forgetConstant(known, symbol);
+		}
+		for (int i = 0; i < MAXCHILDREN; i++) forgetAssigned(node->child[i], known);
+	}
+}
+
+/**
+ * @brief Whether an expression assigns a variable.
+ */
+static bool hasAssign(const TreeNode* node) {
+	if (!node) return FALSE;
+	if (node->nodekind == ExpK && node->kind.exp == AssignK) return TRUE;
+	for (int i = 0; i < MAXCHILDREN; i++)
+		if (hasAssign(node->child[i])) return TRUE;
+	return FALSE;
+}
+
+/**
+ * @brief Whether an expression can be dropped: it has no effect and cannot fault, so it calls,
+ * assigns, indexes and divides nothing.
+ */
+static bool isPure(const TreeNode* node) {
+	if (!node || node->nodekind != ExpK) return FALSE;
+	switch (node->kind.exp) {
+		case ConstK:
+			return TRUE;
+		case IdK:
+			return scalarVariable(node) != NULL;
+		case UnaryK:
+			return isPure(node->child[0]);
+		case OpK:
+			return node->attr.op != OVER && isPure(node->child[0]) && isPure(node->child[1]);
+		default:
+			return FALSE;
+	}
+}
+
+static bool isConstant(const TreeNode* node, int value) {
+	return node->nodekind == ExpK && node->kind.exp == ConstK && node->attr.val == value;
+}
+
+/**
+ * @brief Turns an expression node into a constant, keeping its type and siblings.
+ */
+static void makeConstant(TreeNode* node, int value) {
+	node->kind.exp = ConstK;
+	node->attr.val = value;
+	node->isArray  = FALSE;
+	for (int i = 0; i < MAXCHILDREN; i++) node->child[i] = NULL;
+}
+
+/**
+ * @brief Replaces an expression node by one of its operands, keeping its siblings.
+ */
+static void replaceByChild(TreeNode* node, int index) {
+	TreeNode* const sibling = node->sibling;
+	TreeNode* const parent  = node->parent;
+	*node                   = *node->child[index];
+	node->sibling           = sibling;
+	node->parent            = parent;
+}
+
+/**
+ * @brief Computes an operator on constants as the TM would. Returns FALSE if it would fault.
+ */
+static bool evaluate(TokenType op, int left, int right, int* value) {
+	switch (op) {
+		case PLUS:
+			*value = (int) ((unsigned) left + (unsigned) right);
+			return TRUE;
+		case MINUS:
+			*value = (int) ((unsigned) left - (unsigned) right);
+			return TRUE;
+		case TIMES:
+			*value = (int) ((unsigned) left * (unsigned) right);
+			return TRUE;
+		case OVER:
+			if (right == 0 || (left == INT_MIN && right == -1)) return FALSE;
+			*value = left / right;
+			return TRUE;
+		case LT:
+			*value = left < right;
+			return TRUE;
+		case LEQ:
+			*value = left <= right;
+			return TRUE;
+		case GT:
+			*value = left > right;
+			return TRUE;
+		case GEQ:
+			*value = left >= right;
+			return TRUE;
+		case EQ:
+			*value = left == right;
+			return TRUE;
+		case NEQ:
+			*value = left != right;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * @brief Simplifies an operator whose operands are folded already.
+ */
+static void simplifyOperator(TreeNode* node) {
+	TreeNode* const left  = node->child[0];
+	TreeNode* const right = node->child[1];
+	int             value;
+
+	if (left->kind.exp == ConstK && right->kind.exp == ConstK) {
+		if (evaluate(node->attr.op, left->attr.val, right->attr.val, &value))
+			makeConstant(node, value);
+		return;
+	}
+	switch (node->attr.op) {
+		case PLUS: {
+			if (isConstant(left, 0))
+				replaceByChild(node, 1);
+			else if (isConstant(right, 0))
+				replaceByChild(node, 0);
+			break;
+		}
+		case MINUS: {
+			if (isConstant(right, 0))
+				replaceByChild(node, 0);
+			else if (scalarVariable(left) && scalarVariable(left) == scalarVariable(right))
+				makeConstant(node, 0);
+			break;
+		}
+		case TIMES: {
+			if (isConstant(left, 1))
+				replaceByChild(node, 1);
+			else if (isConstant(right, 1))
+				replaceByChild(node, 0);
+			else if ((isConstant(left, 0) && isPure(right)) ||
+			         (isConstant(right, 0) && isPure(left)))
+				makeConstant(node, 0);
+			break;
+		}
+		case OVER: {
+			if (isConstant(right, 1)) replaceByChild(node, 0);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+static void foldStatements(TreeNode* node, Constants* known);
+
+/**
+ * @brief Folds an expression, in the order the code generator evaluates it, updating known
+ * with the assignments it makes.
+ */
+static void foldExpression(TreeNode* node, Constants* known) {
+	if (!node || node->nodekind != ExpK) return;
+
+	switch (node->kind.exp) {
+		case IdK: {
+			if (node->isArray) {
+				foldExpression(node->child[0], known);
+				break;
+			}
+			BucketList      symbol   = localVariable(node);
+			const Constant* constant = symbol ? findConstant(known, symbol) : NULL;
+			if (constant) makeConstant(node, constant->value);
+			break;
+		}
+		case AssignK: {
+			foldExpression(node->child[1], known);
+			if (node->child[0]->isArray) {
+				foldExpression(node->child[0]->child[0], known);
+				break;
+			}
+			BucketList symbol = localVariable(node->child[0]);
+			if (!symbol) break;
+			if (node->child[1]->kind.exp == ConstK)
+				setConstant(known, symbol, node->child[1]->attr.val);
+			else
+				forgetConstant(known, symbol);
+			break;
+		}
+		case CallK: {
+			for (TreeNode* argument = node->child[0]; argument; argument = argument->sibling)
+				foldExpression(argument, known);
+			break;
+		}
+		case UnaryK: {
+			foldExpression(node->child[0], known);
+			if (node->child[0]->kind.exp != ConstK) break;
+			if (node->attr.op == MINUS)
+				makeConstant(node, (int) (0u - (unsigned) node->child[0]->attr.val));
+			else
+				makeConstant(node, node->child[0]->attr.val);
+			break;
+		}
+		case OpK: {
+			// With an assignment inside, the operands may be evaluated in either order (-r)
+			if (hasAssign(node->child[0]) || hasAssign(node->child[1])) {
+				forgetAssigned(node->child[0], known);
+				forgetAssigned(node->child[1], known);
+				for (int i = 0; i < 2; i++) {
+					Constants operand = copyConstants(known);
+					foldExpression(node->child[i], &operand);
+					freeConstants(&operand);
+				}
+			} else {
+				foldExpression(node->child[0], known);
+				foldExpression(node->child[1], known);
+			}
+			simplifyOperator(node);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Folds a statement, updating known with the values variables have after it.
+ */
+static void foldStatement(TreeNode* node, Constants* known) {
+	if (node->nodekind == ExpK) {
+		foldExpression(node, known);
+		return;
+	}
+
+	switch (node->kind.stmt) {
+		case FuncK: {
+			Constants body = {NULL, 0, 0};
+			foldStatements(node->child[1], &body);
+			freeConstants(&body);
+			break;
+		}
+		case VarK: {
+			BucketList symbol = symbolTableLookupFromScope(node->attr.name, node->scope);
+			if (symbol) forgetConstant(known, symbol);
+			break;
+		}
+		case CompoundK: {
+			foldStatements(node->child[0], known);
+			foldStatements(node->child[1], known);
+			break;
+		}
+		case IfK: {
+			foldExpression(node->child[0], known);
+			const bool constantCondition = node->child[0]->kind.exp == ConstK;
+			Constants  thenKnown         = copyConstants(known);
+			foldStatements(node->child[1], &thenKnown);
+			foldStatements(node->child[2], known);
+			if (!constantCondition)
+				joinConstants(known, &thenKnown);
+			else if (node->child[0]->attr.val != 0) { // the else part never runs
+				freeConstants(known);
+				*known = thenKnown;
+				break;
+			}
+			freeConstants(&thenKnown);
+			break;
+		}
+		case WhileK: {
+			// What the loop assigns is unknown when the condition is evaluated again
+			forgetAssigned(node->child[0], known);
+			forgetAssigned(node->child[1], known);
+			foldExpression(node->child[0], known);
+			Constants body = copyConstants(known);
+			foldStatements(node->child[1], &body);
+			freeConstants(&body);
+			break;
+		}
+		case ReturnK: {
+			foldExpression(node->child[0], known);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Folds a statement and its siblings in order.
+ */
+static void foldStatements(TreeNode* node, Constants* known) {
+	for (; node; node = node->sibling) foldStatement(node, known);
+}
+
+void foldConstants(TreeNode* syntaxTree) {
+	Constants known = {NULL, 0, 0};
+	foldStatements(syntaxTree, &known);
+	freeConstants(&known);
+}
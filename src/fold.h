@@ -0,0 +1,14 @@
+#ifndef _FOLD_H_
+#define _FOLD_H_
+
+#include "globals.h"
+
+/**
+ * @brief Folds constant subexpressions of a checked syntax tree, replaces reads of local
+ * variables whose value is known by that value and simplifies algebraic identities.
+ *
+ * @param syntaxTree The root of the syntax tree, after typeCheck.
+ */
+void foldConstants(TreeNode* syntaxTree);
+
+#endif
@@ -15,7 +15,6 @@
 
 #define SIZE 211
 #define SHIFT 4
-#define MAX_MEMORY 1023
 
 #ifndef FALSE
 #define FALSE 0
@@ -167,6 +166,34 @@ extern int TraceCode;
  */
 extern int Error;
 
+/**
+ * @brief MaxMemory is the highest data memory address of the target TM (its data memory size
+ * minus one, set with -m). Frame offsets are relative to it, globals are allocated from 0 up.
+ */
+extern int MaxMemory;
+
+/**
+ * @brief Optimize = TRUE (set with -O) runs the peephole optimizer over the generated code.
+ */
+extern int Optimize;
+
+/**
+ * @brief AllocateRegisters = TRUE (set with -r) keeps expression temporaries in registers.
+ */
+extern int AllocateRegisters;
+
+/**
+ * @brief FoldConstants = TRUE (set with -f) folds and propagates constants in the syntax tree
+ * before code generation.
+ */
+extern int FoldConstants;
+
+/**
+ * @brief BranchOnCompare = TRUE (set with -j) makes if and while conditions that compare jump on
+ * the comparison directly instead of testing a 0 or 1 value.
+ */
+extern int BranchOnCompare;
+
 #ifndef YYPARSER
 #include "parser.h"
 #define ENDFILE 0
@@ -19,6 +19,8 @@
 #include "analyze.h"
 #if !NO_CODE
 #include "cgen.h"
+#include "code.h"
+#include "fold.h"
 #endif
 #endif
 #endif
@@ -39,13 +41,54 @@ int TraceCode    = TRUE;
 
 int Error = FALSE;
 
+/* set by -b: also write the generated code as a binary TM object file */
+int WriteObject = FALSE;
+
+/* set by -m: highest data memory address of the target TM */
+int MaxMemory = 1023;
+
+/* set by -O: run the peephole optimizer over the generated code */
+int Optimize = FALSE;
+
+/* set by -r: keep expression temporaries in registers */
+int AllocateRegisters = FALSE;
+
+/* set by -f: fold and propagate constants in the syntax tree */
+int FoldConstants = FALSE;
+
+/* set by -j: branch on comparisons in if and while conditions directly */
+int BranchOnCompare = FALSE;
+
 int main(int argc, char* argv[]) {
 	TreeNode* syntaxTree;
 
 	//// opening sources ////
 	char pgm[120]; /* source code file name */
+	char* progName = argv[0];
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-b") == 0)
+			WriteObject = TRUE;
+		else if (strcmp(argv[1], "-O") == 0)
+			Optimize = TRUE;
+		else if (strcmp(argv[1], "-r") == 0)
+			AllocateRegisters = TRUE;
+		else if (strcmp(argv[1], "-f") == 0)
+			FoldConstants = TRUE;
+		else if (strcmp(argv[1], "-j") == 0)
+			BranchOnCompare = TRUE;
+		else if (strcmp(argv[1], "-m") == 0 && argc > 2 && atoi(argv[2]) > 1) {
+			MaxMemory = atoi(argv[2]) - 1;
+			argv++;
+			argc--;
+		} else
+			break;
+		argv++;
+		argc--;
+	}
 	if (argc < 2 || argc > 3) {
-		fprintf(stderr, "usage: %s <filename> [<detailpath>]\n", argv[0]);
+		fprintf(stderr,
+		        "usage: %s [-b] [-O] [-r] [-f] [-j] [-m <words>] <filename> [<detailpath>]\n",
+		        progName);
 		exit(1);
 	}
 	strcpy(pgm, argv[1]);
@@ -94,7 +137,14 @@ int main(int argc, char* argv[]) {
 #if !NO_CODE
 	doneTABstartGEN();
 	if (!Error) {
+		if (FoldConstants) foldConstants(syntaxTree);
 		generateCode(syntaxTree);
+		if (WriteObject) {
+			char path[512], base[256], extension[256], object[1024];
+			splitFileName(pgm, path, base, extension);
+			snprintf(object, sizeof(object), "%s/%s_gen.tmo", detailpath, base);
+			if (!writeObject(object)) fprintf(stderr, "Could not write %s\n", object);
+		}
 	}
 #endif
 #endif
@@ -5,424 +5,313 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#ifndef TRUE
-#define TRUE 1
-#endif
-#ifndef FALSE
-#define FALSE 0
-#endif
+#include "libtm/tm.h"
 
 /******* const *******/
-#define IADDR_SIZE 1024 /* increase for large programs */
-#define DADDR_SIZE 1024 /* increase for large programs */
-#define NO_REGS 8
-#define PC_REG 7
-
 #define LINESIZE 121
-#define WORDSIZE 20
-
-/******* type  *******/
-
-typedef enum {
-	opclRR, /* reg operands r,s,t */
-	opclRM, /* reg r, mem d+s */
-	opclRA  /* reg r, int d+s */
-} OPCLASS;
-
-typedef enum {
-	/* RR instructions */
-	opHALT,  /* RR     halt, operands are ignored */
-	opIN,    /* RR     read into reg(r); s and t are ignored */
-	opOUT,   /* RR     write from reg(r), s and t are ignored */
-	opADD,   /* RR     reg(r) = reg(s)+reg(t) */
-	opSUB,   /* RR     reg(r) = reg(s)-reg(t) */
-	opMUL,   /* RR     reg(r) = reg(s)*reg(t) */
-	opDIV,   /* RR     reg(r) = reg(s)/reg(t) */
-	opRRLim, /* limit of RR opcodes */
-
-	/* RM instructions */
-	opLD,    /* RM     reg(r) = mem(d+reg(s)) */
-	opST,    /* RM     mem(d+reg(s)) = reg(r) */
-	opRMLim, /* Limit of RM opcodes */
-
-	/* RA instructions */
-	opLDA,  /* RA     reg(r) = d+reg(s) */
-	opLDC,  /* RA     reg(r) = d ; reg(s) is ignored */
-	opJLT,  /* RA     if reg(r)<0 then reg(7) = d+reg(s) */
-	opJLE,  /* RA     if reg(r)<=0 then reg(7) = d+reg(s) */
-	opJGT,  /* RA     if reg(r)>0 then reg(7) = d+reg(s) */
-	opJGE,  /* RA     if reg(r)>=0 then reg(7) = d+reg(s) */
-	opJEQ,  /* RA     if reg(r)==0 then reg(7) = d+reg(s) */
-	opJNE,  /* RA     if reg(r)!=0 then reg(7) = d+reg(s) */
-	opRALim /* Limit of RA opcodes */
-} OPCODE;
-
-typedef enum { srOKAY, srHALT, srIMEM_ERR, srDMEM_ERR, srZERODIVIDE } STEPRESULT;
-
-typedef struct {
-	int iop;
-	int iarg1;
-	int iarg2;
-	int iarg3;
-} INSTRUCTION;
+
+#define OUTBUF_SIZE 65536 /* OUT text buffered before it is written */
+#define TRACEBUF_SIZE 65536 /* instructions buffered by -T before they are written */
 
 /******** vars ********/
 int iloc       = 0;
 int dloc       = 0;
 int traceflag  = FALSE;
 int icountflag = FALSE;
+int batchflag  = FALSE;
+long stepLimit = 0; /* 0 means no limit */
+long timeLimit = 0; /* milliseconds of each run, 0 means no limit */
+int  engine    = engSTEP;
+int  codeSize  = 0; /* instruction memory words, 0 means IADDR_SIZE */
+int  dataSize  = 0; /* data memory words, 0 means DADDR_SIZE */
 
-INSTRUCTION iMem[IADDR_SIZE];
-int         dMem[DADDR_SIZE];
-int         reg[NO_REGS];
+TMProgram* program;
+TMContext* context;
 
-char* opCodeTab[] = {
-    "HALT", "IN", "OUT", "ADD", "SUB", "MUL", "DIV", "????",
-    /* RR opcodes */
-    "LD", "ST", "????", /* RM opcodes */
-    "LDA", "LDC", "JLT", "JLE", "JGT", "JGE", "JEQ", "JNE", "????"
-    /* RA opcodes */
-};
+FILE*     outFile; /* destination of OUT and HALT messages */
+TMOutputs outputs; /* their text; batch mode writes it at HALT or when it reaches OUTBUF_SIZE */
 
-char* stepResultTab[] = {"OK", "Halted", "Instruction Memory Fault", "Data Memory Fault",
-                         "Division by 0"};
+char* profileName = NULL; /* -p: execution profile written here when tm ends */
 
-char  pgmName[20];
-FILE* pgm;
+char* memProfileName = NULL; /* -d: data memory profile written here when tm ends */
+int   cacheSets      = 16;   /* -k: geometry of the cache simulated by -d */
+int   cacheWays      = 2;
+int   cacheLine      = 4;
 
-char in_Line[LINESIZE];
-int  lineLen;
-int  inCol;
-int  num;
-char word[WORDSIZE];
-char ch;
-int  done;
+TMCostModel  costModel;
+TMCostModel* cost = NULL; /* -c: cycles are estimated with costModel */
 
-/********************************************/
-int opClass(int c) {
-	if (c <= opRRLim)
-		return (opclRR);
-	else if (c <= opRMLim)
-		return (opclRM);
-	else
-		return (opclRA);
-} /* opClass */
+char*    traceName = NULL; /* -T: binary trace of the instructions executed */
+int      traceLast = 0;    /* -r: only the last instructions are written, when tm ends */
+FILE*    traceFile;
+TMTrace* trace;
+
+TMInputs inputs; /* batch mode input vector, consumed by IN */
+
+char*       recordName = NULL; /* -R: replay log of the batch run written here */
+char*       replayName = NULL; /* -P: replay log the IN values come from */
+long        checkpointInterval = 0; /* -K: instructions between checkpoints, 0 for the default */
+FILE*       logFile;
+TMRecorder* recorder = NULL;
+TMReplay*   replay   = NULL;
+
+TMSnapshot* mark = NULL; /* state saved by the m(ark command */
+
+char pgmName[1024];
+
+char      in_Line[LINESIZE];
+TMScanner sc;
+int       done;
 
 /********************************************/
 void writeInstruction(int loc) {
 	printf("%5d: ", loc);
-	if ((loc >= 0) && (loc < IADDR_SIZE)) {
-		printf("%6s%3d,", opCodeTab[iMem[loc].iop], iMem[loc].iarg1);
-		switch (opClass(iMem[loc].iop)) {
-			case opclRR:
-				printf("%1d,%1d", iMem[loc].iarg2, iMem[loc].iarg3);
-				break;
-			case opclRM:
-			case opclRA:
-				printf("%3d(%1d)", iMem[loc].iarg2, iMem[loc].iarg3);
-				break;
-		}
+	if ((loc >= 0) && (loc < tmCodeSize(program))) {
+		tmWriteInstruction(program, loc, stdout);
 		printf("\n");
 	}
 } /* writeInstruction */
 
 /********************************************/
-void getCh(void) {
-	if (++inCol < lineLen)
-		ch = in_Line[inCol];
-	else
-		ch = ' ';
-} /* getCh */
+void writeOutputs(void) {
+	tmWriteOutputs(&outputs, outFile);
+	fflush(outFile);
+} /* writeOutputs */
 
 /********************************************/
-int nonBlank(void) {
-	while ((inCol < lineLen) && (in_Line[inCol] == ' ')) inCol++;
-	if (inCol < lineLen) {
-		ch = in_Line[inCol];
-		return TRUE;
-	} else {
-		ch = ' ';
-		return FALSE;
+/* IN in interactive mode: prompt until a number is entered */
+int promptInput(void* user, int* value) {
+	int ok;
+	do {
+		printf("Enter value for IN instruction: ");
+		fflush(stdin);
+		fflush(stdout);
+		fgets(in_Line, LINESIZE, stdin);
+		tmScanLine(&sc, in_Line, strlen(in_Line));
+		ok = tmGetNum(&sc);
+		if (!ok)
+			printf("Illegal value\n");
+		else
+			*value = sc.num;
+	} while (!ok);
+	return TRUE;
+} /* promptInput */
+
+/********************************************/
+void writeOutput(void* user, int value) {
+	if (!tmAppendOutput(&outputs, value)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
 	}
-} /* nonBlank */
+	/* the debugger shows each value at once, between the instructions it traces */
+	if (!batchflag)
+		writeOutputs();
+	else if (outputs.length >= OUTBUF_SIZE)
+		tmWriteOutputs(&outputs, outFile);
+} /* writeOutput */
 
 /********************************************/
-int getNum(void) {
-	int sign;
-	int term;
-	int temp = FALSE;
-	num      = 0;
-	do {
-		sign = 1;
-		while (nonBlank() && ((ch == '+') || (ch == '-'))) {
-			temp = FALSE;
-			if (ch == '-') sign = -sign;
-			getCh();
-		}
-		term = 0;
-		nonBlank();
-		while (isdigit(ch)) {
-			temp = TRUE;
-			term = term * 10 + (ch - '0');
-			getCh();
-		}
-		num = num + (term * sign);
-	} while ((nonBlank()) && ((ch == '+') || (ch == '-')));
-	return temp;
-} /* getNum */
+void writeHalt(void* user, int r, int s, int t) {
+	tmAppendHalt(&outputs, r, s, t);
+	writeOutputs();
+} /* writeHalt */
 
 /********************************************/
-int getWord(void) {
-	int temp   = FALSE;
-	int length = 0;
-	if (nonBlank()) {
-		while (isalnum(ch)) {
-			if (length < WORDSIZE - 1) word[length++] = ch;
-			getCh();
-		}
-		word[length] = '\0';
-		temp         = (length != 0);
+/* run to completion or a breakpoint, one traced instruction at a time if tracing is on */
+STEPRESULT runTM(void) {
+	STEPRESULT stepResult = srOKAY;
+	long       start      = context->steps;
+	if (!traceflag)
+		return (recorder != NULL) ? tmRecordRun(recorder, stepLimit) : tmRun(context, stepLimit);
+	while (stepResult == srOKAY) {
+		if ((stepLimit > 0) && (context->steps - start >= stepLimit)) return srBUDGET;
+		if ((context->steps > start) && tmBreakpointAt(program, context->reg[PC_REG]))
+			return srBREAK;
+		iloc = context->reg[PC_REG];
+		writeInstruction(iloc);
+		stepResult = tmStep(context);
 	}
-	return temp;
-} /* getWord */
+	return stepResult;
+} /* runTM */
 
 /********************************************/
-int skipCh(char c) {
-	int temp = FALSE;
-	if (nonBlank() && (ch == c)) {
-		getCh();
-		temp = TRUE;
+int readInputFile(char* fileName) {
+	FILE* f;
+	int   ok;
+	f = fopen(fileName, "r");
+	if (f == NULL) {
+		fprintf(stderr, "input file '%s' not found\n", fileName);
+		return FALSE;
 	}
-	return temp;
-} /* skipCh */
+	ok = tmReadInputs(&inputs, f);
+	fclose(f);
+	if (!ok) fprintf(stderr, "Illegal input value in '%s'\n", fileName);
+	return ok;
+} /* readInputFile */
 
 /********************************************/
-int atEOL(void) {
-	return (!nonBlank());
-} /* atEOL */
+/* instructions per opcode class executed since start[] */
+void writeClassCounts(FILE* f, const long* start) {
+	const long* count = context->classCount;
+	fprintf(f, "RR %ld, RM %ld, RA %ld instructions\n", count[opclRR] - start[opclRR],
+	        count[opclRM] - start[opclRM], count[opclRA] - start[opclRA]);
+} /* writeClassCounts */
 
 /********************************************/
-int error(char* msg, int lineNo, int instNo) {
-	printf("Line %d", lineNo);
-	if (instNo >= 0) printf(" (Instruction %d)", instNo);
-	printf("   %s\n", msg);
-	return FALSE;
-} /* error */
+/* estimated cycles of the instructions counted by the profile, 0 without a cost model */
+long cycles(void) {
+	return (cost != NULL) ? tmCycles(program, context->profile, cost) : 0;
+} /* cycles */
 
 /********************************************/
-int readInstructions(void) {
-	OPCODE op;
-	int    arg1, arg2, arg3;
-	int    loc, regNo, lineNo;
-	for (regNo = 0; regNo < NO_REGS; regNo++) reg[regNo] = 0;
-	dMem[0] = DADDR_SIZE - 1;
-	for (loc = 1; loc < DADDR_SIZE; loc++) dMem[loc] = 0;
-	for (loc = 0; loc < IADDR_SIZE; loc++) {
-		iMem[loc].iop   = opHALT;
-		iMem[loc].iarg1 = 0;
-		iMem[loc].iarg2 = 0;
-		iMem[loc].iarg3 = 0;
+int runBatch(void) {
+	STEPRESULT stepResult;
+	long       start[3] = {0, 0, 0};
+	stepResult = runTM();
+	writeOutputs();
+	fprintf(stderr, "%s after %ld instructions\n", tmResultTab[stepResult], context->steps);
+	writeClassCounts(stderr, start);
+	if (cost != NULL) fprintf(stderr, "%ld estimated cycles\n", cycles());
+	if ((recorder != NULL) && (!tmRecordEnd(recorder, stepResult) || (fclose(logFile) != 0))) {
+		fprintf(stderr, "cannot write replay log '%s'\n", recordName);
+		return 1;
 	}
-	lineNo = 0;
-	while (!feof(pgm)) {
-		fgets(in_Line, LINESIZE - 2, pgm);
-		inCol = 0;
-		lineNo++;
-		lineLen = strlen(in_Line) - 1;
-		if (in_Line[lineLen] == '\n')
-			in_Line[lineLen] = '\0';
+	return tmExitTab[stepResult];
+} /* runBatch */
+
+/********************************************/
+int readCostModel(char* fileName) {
+	FILE* f;
+	int   ok, badLine;
+	f = fopen(fileName, "r");
+	if (f == NULL) {
+		fprintf(stderr, "cost model file '%s' not found\n", fileName);
+		return FALSE;
+	}
+	tmCostModelInit(&costModel);
+	ok = tmReadCostModel(&costModel, f, &badLine);
+	fclose(f);
+	if (!ok) {
+		if (badLine > 0)
+			fprintf(stderr, "%s:%d: opcode or event and cycles expected\n", fileName, badLine);
 		else
-			in_Line[++lineLen] = '\0';
-		if ((nonBlank()) && (in_Line[inCol] != '*')) {
-			if (!getNum()) return error("Bad location", lineNo, -1);
-			loc = num;
-			if (loc > IADDR_SIZE) return error("Location too large", lineNo, loc);
-			if (!skipCh(':')) return error("Missing colon", lineNo, loc);
-			if (!getWord()) return error("Missing opcode", lineNo, loc);
-			op = opHALT;
-			while ((op < opRALim) && (strncmp(opCodeTab[op], word, 4) != 0)) op++;
-			if (strncmp(opCodeTab[op], word, 4) != 0) return error("Illegal opcode", lineNo, loc);
-			switch (opClass(op)) {
-				case opclRR:
-					/***********************************/
-					if ((!getNum()) || (num < 0) || (num >= NO_REGS))
-						return error("Bad first register", lineNo, loc);
-					arg1 = num;
-					if (!skipCh(',')) return error("Missing comma", lineNo, loc);
-					if ((!getNum()) || (num < 0) || (num >= NO_REGS))
-						return error("Bad second register", lineNo, loc);
-					arg2 = num;
-					if (!skipCh(',')) return error("Missing comma", lineNo, loc);
-					if ((!getNum()) || (num < 0) || (num >= NO_REGS))
-						return error("Bad third register", lineNo, loc);
-					arg3 = num;
-					break;
-
-				case opclRM:
-				case opclRA:
-					/***********************************/
-					if ((!getNum()) || (num < 0) || (num >= NO_REGS))
-						return error("Bad first register", lineNo, loc);
-					arg1 = num;
-					if (!skipCh(',')) return error("Missing comma", lineNo, loc);
-					if (!getNum()) return error("Bad displacement", lineNo, loc);
-					arg2 = num;
-					if (!skipCh('(') && !skipCh(',')) return error("Missing LParen", lineNo, loc);
-					if ((!getNum()) || (num < 0) || (num >= NO_REGS))
-						return error("Bad second register", lineNo, loc);
-					arg3 = num;
-					break;
-			}
-			iMem[loc].iop   = op;
-			iMem[loc].iarg1 = arg1;
-			iMem[loc].iarg2 = arg2;
-			iMem[loc].iarg3 = arg3;
-		}
+			fprintf(stderr, "cannot read cost model file '%s'\n", fileName);
+		return FALSE;
 	}
+	cost = &costModel;
 	return TRUE;
-} /* readInstructions */
+} /* readCostModel */
 
 /********************************************/
-STEPRESULT stepTM(void) {
-	INSTRUCTION currentinstruction;
-	int         pc;
-	int         r, s, t, m;
-	int         ok;
-
-	pc = reg[PC_REG];
-	if ((pc < 0) || (pc > IADDR_SIZE)) return srIMEM_ERR;
-	reg[PC_REG]        = pc + 1;
-	currentinstruction = iMem[pc];
-	switch (opClass(currentinstruction.iop)) {
-		case opclRR:
-			/***********************************/
-			r = currentinstruction.iarg1;
-			s = currentinstruction.iarg2;
-			t = currentinstruction.iarg3;
-			break;
-
-		case opclRM:
-			/***********************************/
-			r = currentinstruction.iarg1;
-			s = currentinstruction.iarg3;
-			m = currentinstruction.iarg2 + reg[s];
-			if ((m < 0) || (m > DADDR_SIZE)) return srDMEM_ERR;
-			break;
-
-		case opclRA:
-			/***********************************/
-			r = currentinstruction.iarg1;
-			s = currentinstruction.iarg3;
-			m = currentinstruction.iarg2 + reg[s];
-			break;
-	} /* case */
-
-	switch (currentinstruction.iop) { /* RR instructions */
-		case opHALT:
-			/***********************************/
-			printf("HALT: %1d,%1d,%1d\n", r, s, t);
-			return srHALT;
-			/* break; */
-
-		case opIN:
-			/***********************************/
-			do {
-				printf("Enter value for IN instruction: ");
-				fflush(stdin);
-				fflush(stdout);
-				fgets(in_Line, LINESIZE, stdin);
-				lineLen = strlen(in_Line);
-				inCol   = 0;
-				ok      = getNum();
-				if (!ok)
-					printf("Illegal value\n");
-				else
-					reg[r] = num;
-			} while (!ok);
-			break;
+int writeProfile(void) {
+	FILE* f;
+	int   ok;
+	if (profileName == NULL) return TRUE;
+	f = fopen(profileName, "w");
+	if (f == NULL) {
+		fprintf(stderr, "cannot open profile file '%s'\n", profileName);
+		return FALSE;
+	}
+	ok = tmWriteProfile(program, context->profile, cost, f);
+	return (fclose(f) == 0) && ok;
+} /* writeProfile */
 
-		case opOUT:
-			printf("OUT instruction prints: %d\n", reg[r]);
-			break;
-		case opADD:
-			reg[r] = reg[s] + reg[t];
-			break;
-		case opSUB:
-			reg[r] = reg[s] - reg[t];
-			break;
-		case opMUL:
-			reg[r] = reg[s] * reg[t];
-			break;
+/********************************************/
+int openLog(void) {
+	char* logName = (recordName != NULL) ? recordName : replayName;
+	logFile       = fopen(logName, (recordName != NULL) ? "wb" : "rb");
+	if (logFile == NULL) {
+		fprintf(stderr, "cannot open replay log '%s'\n", logName);
+		return FALSE;
+	}
+	if (recordName != NULL) {
+		recorder = tmRecordNew(context, logFile, checkpointInterval);
+		if (recorder == NULL) fprintf(stderr, "out of memory\n");
+		return recorder != NULL;
+	}
+	replay = tmReplayOpen(context, logFile);
+	if (replay == NULL)
+		fprintf(stderr, "'%s' is not a replay log of this program and data memory size\n",
+		        replayName);
+	return replay != NULL;
+} /* openLog */
 
-		case opDIV:
-			/***********************************/
-			if (reg[t] != 0)
-				reg[r] = reg[s] / reg[t];
-			else
-				return srZERODIVIDE;
-			break;
+/********************************************/
+/* go to step n of the replayed run, or back to where it was after a restore */
+void seekReplay(long n) {
+	STEPRESULT stepResult;
+	if (!tmReplaySeek(replay, n, &stepResult))
+		printf("Cannot read replay log '%s'\n", replayName);
+	else if (stepResult != srOKAY)
+		printf("%s after %ld instructions\n", tmResultTab[stepResult], context->steps);
+	iloc = context->reg[PC_REG];
+} /* seekReplay */
 
-		/*************** RM instructions ********************/
-		case opLD:
-			reg[r] = dMem[m];
-			break;
-		case opST:
-			dMem[m] = reg[r];
-			break;
+/********************************************/
+int writeMemProfile(void) {
+	FILE* f;
+	int   ok;
+	if (memProfileName == NULL) return TRUE;
+	f = fopen(memProfileName, "w");
+	if (f == NULL) {
+		fprintf(stderr, "cannot open memory profile file '%s'\n", memProfileName);
+		return FALSE;
+	}
+	ok = tmWriteMemProfile(program, context->memProfile, f);
+	return (fclose(f) == 0) && ok;
+} /* writeMemProfile */
 
-		/*************** RA instructions ********************/
-		case opLDA:
-			reg[r] = m;
-			break;
-		case opLDC:
-			reg[r] = currentinstruction.iarg2;
-			break;
-		case opJLT:
-			if (reg[r] < 0) reg[PC_REG] = m;
-			break;
-		case opJLE:
-			if (reg[r] <= 0) reg[PC_REG] = m;
-			break;
-		case opJGT:
-			if (reg[r] > 0) reg[PC_REG] = m;
-			break;
-		case opJGE:
-			if (reg[r] >= 0) reg[PC_REG] = m;
-			break;
-		case opJEQ:
-			if (reg[r] == 0) reg[PC_REG] = m;
-			break;
-		case opJNE:
-			if (reg[r] != 0) reg[PC_REG] = m;
-			break;
+/********************************************/
+int openTrace(void) {
+	traceFile = fopen(traceName, "wb");
+	if (traceFile == NULL) {
+		fprintf(stderr, "cannot open trace file '%s'\n", traceName);
+		return FALSE;
+	}
+	if (traceLast > 0)
+		trace = tmTraceNew(traceLast, NULL);
+	else
+		trace = tmTraceNew(TRACEBUF_SIZE, traceFile);
+	if (trace == NULL) {
+		fprintf(stderr, "cannot write trace file '%s'\n", traceName);
+		return FALSE;
+	}
+	context->trace = trace;
+	return TRUE;
+} /* openTrace */
 
-			/* end of legal instructions */
-	} /* case */
-	return srOKAY;
-} /* stepTM */
+/********************************************/
+int writeTrace(void) {
+	int ok;
+	if (traceName == NULL) return TRUE;
+	ok = (traceLast > 0) ? tmTraceWrite(trace, traceFile) : tmTraceFlush(trace);
+	ok = (fclose(traceFile) == 0) && ok;
+	if (!ok) fprintf(stderr, "cannot write trace file '%s'\n", traceName);
+	return ok;
+} /* writeTrace */
 
 /********************************************/
 int doCommand(void) {
 	char cmd;
 	int  stepcnt = 0, i;
-	int  printcnt;
+	int  printcnt, first;
 	int  stepResult;
-	int  regNo, loc;
+	long count, start;
+	long classes[3];
 	do {
 		printf("Enter command: ");
 		fflush(stdin);
 		fflush(stdout);
 		fgets(in_Line, LINESIZE, stdin);
-		lineLen = strlen(in_Line);
-		inCol   = 0;
-	} while (!getWord());
+		tmScanLine(&sc, in_Line, strlen(in_Line));
+	} while (!tmGetWord(&sc));
 
-	cmd = word[0];
+	cmd = sc.word[0];
 	switch (cmd) {
 		case 't':
 			/***********************************/
@@ -454,6 +343,16 @@ int doCommand(void) {
 			       " ('go' only)\n");
 			printf("   c(lear         "
 			       "Reset simulator for new execution of program\n");
+			printf("   b(reak <loc>   "
+			       "Toggle a breakpoint at loc, or list the breakpoints\n");
+			printf("   w(atch <b <n>> "
+			       "Toggle a watch on n dMem locations starting at b, or list them\n");
+			printf("   m(ark          "
+			       "Save the current state for u(ndo\n");
+			printf("   u(ndo          "
+			       "Return to the state saved by m(ark\n");
+			printf("   j(ump <n>      "
+			       "Go to the state after n instructions of the replayed run\n");
 			printf("   h(elp          "
 			       "Cause this list of commands to be printed\n");
 			printf("   q(uit          "
@@ -472,10 +371,10 @@ int doCommand(void) {
 
 		case 's':
 			/***********************************/
-			if (atEOL())
+			if (tmAtEOL(&sc))
 				stepcnt = 1;
-			else if (getNum())
-				stepcnt = abs(num);
+			else if (tmGetNum(&sc))
+				stepcnt = abs(sc.num);
 			else
 				printf("Step count?\n");
 			break;
@@ -487,7 +386,7 @@ int doCommand(void) {
 		case 'r':
 			/***********************************/
 			for (i = 0; i < NO_REGS; i++) {
-				printf("%1d: %4d    ", i, reg[i]);
+				printf("%1d: %4d    ", i, context->reg[i]);
 				if ((i % 4) == 3) printf("\n");
 			}
 			break;
@@ -495,14 +394,16 @@ int doCommand(void) {
 		case 'i':
 			/***********************************/
 			printcnt = 1;
-			if (getNum()) {
-				iloc = num;
-				if (getNum()) printcnt = num;
+			if (tmGetNum(&sc)) {
+				iloc = sc.num;
+				if (tmGetNum(&sc)) printcnt = sc.num;
 			}
-			if (!atEOL())
+			if (!tmAtEOL(&sc))
 				printf("Instruction locations?\n");
 			else {
-				while ((iloc >= 0) && (iloc < IADDR_SIZE) && (printcnt > 0)) {
+				while ((iloc >= 0) && (iloc < tmCodeSize(program)) && (printcnt > 0)) {
+					if (tmSymbolAt(program, iloc) != NULL)
+						printf("* %s:\n", tmSymbolAt(program, iloc));
 					writeInstruction(iloc);
 					iloc++;
 					printcnt--;
@@ -513,15 +414,15 @@ int doCommand(void) {
 		case 'd':
 			/***********************************/
 			printcnt = 1;
-			if (getNum()) {
-				dloc = num;
-				if (getNum()) printcnt = num;
+			if (tmGetNum(&sc)) {
+				dloc = sc.num;
+				if (tmGetNum(&sc)) printcnt = sc.num;
 			}
-			if (!atEOL())
+			if (!tmAtEOL(&sc))
 				printf("Data locations?\n");
 			else {
-				while ((dloc >= 0) && (dloc < DADDR_SIZE) && (printcnt > 0)) {
-					printf("%5d: %5d\n", dloc, dMem[dloc]);
+				while ((dloc >= 0) && (dloc < context->dSize) && (printcnt > 0)) {
+					printf("%5d: %5d\n", dloc, context->dMem[dloc]);
 					dloc++;
 					printcnt--;
 				}
@@ -533,9 +434,72 @@ int doCommand(void) {
 			iloc    = 0;
 			dloc    = 0;
 			stepcnt = 0;
-			for (regNo = 0; regNo < NO_REGS; regNo++) reg[regNo] = 0;
-			dMem[0] = DADDR_SIZE - 1;
-			for (loc = 1; loc < DADDR_SIZE; loc++) dMem[loc] = 0;
+			if (replay != NULL)
+				seekReplay(0);
+			else
+				tmReset(context);
+			break;
+
+		case 'j':
+			/***********************************/
+			if (replay == NULL)
+				printf("No replay log\n");
+			else if (!tmGetNum(&sc) || !tmAtEOL(&sc) || (sc.num < 0))
+				printf("Instruction count?\n");
+			else
+				seekReplay(sc.num);
+			break;
+
+		case 'b':
+			/***********************************/
+			if (tmAtEOL(&sc)) {
+				for (i = 0; i < tmCodeSize(program); i++)
+					if (tmBreakpointAt(program, i)) writeInstruction(i);
+			} else if (!tmGetNum(&sc) || !tmAtEOL(&sc) ||
+			           !tmSetBreakpoint(program, sc.num, !tmBreakpointAt(program, sc.num)))
+				printf("Breakpoint location?\n");
+			break;
+
+		case 'w':
+			/***********************************/
+			if (tmAtEOL(&sc)) {
+				for (i = 0; i < context->watchCount; i++)
+					printf("%5d..%d\n", context->watchTab[2 * i], context->watchTab[2 * i + 1]);
+				break;
+			}
+			printcnt = 1;
+			first    = -1;
+			if (tmGetNum(&sc)) {
+				first = sc.num;
+				if (tmGetNum(&sc)) printcnt = sc.num;
+			}
+			if (!tmAtEOL(&sc) || (printcnt <= 0) ||
+			    (!tmSetWatchpoint(context, first, first + printcnt - 1, FALSE) &&
+			     !tmSetWatchpoint(context, first, first + printcnt - 1, TRUE)))
+				printf("Data locations?\n");
+			break;
+
+		case 'm':
+			/***********************************/
+			tmSnapshotFree(mark);
+			mark = tmSnapshot(context);
+			if (mark == NULL) printf("Out of memory, no state saved\n");
+			break;
+
+		case 'u':
+			/***********************************/
+			if (mark == NULL)
+				printf("No state saved\n");
+			else {
+				tmRestore(context, mark);
+				iloc = context->reg[PC_REG];
+				if (replay != NULL) {
+					/* the replay's IN values must follow the restored state */
+					count = context->steps;
+					seekReplay(0);
+					seekReplay(count);
+				}
+			}
 			break;
 
 		case 'q':
@@ -548,23 +512,30 @@ int doCommand(void) {
 	stepResult = srOKAY;
 	if (stepcnt > 0) {
 		if (cmd == 'g') {
-			stepcnt = 0;
-			while (stepResult == srOKAY) {
-				iloc = reg[PC_REG];
-				if (traceflag) writeInstruction(iloc);
-				stepResult = stepTM();
-				stepcnt++;
+			memcpy(classes, context->classCount, sizeof(classes));
+			count      = context->steps;
+			start      = cycles();
+			stepResult = runTM();
+			count      = context->steps - count;
+			if (icountflag) {
+				printf("Number of instructions executed = %ld\n", count);
+				writeClassCounts(stdout, classes);
+				if (cost != NULL) printf("Estimated cycles = %ld\n", cycles() - start);
 			}
-			if (icountflag) printf("Number of instructions executed = %d\n", stepcnt);
 		} else {
 			while ((stepcnt > 0) && (stepResult == srOKAY)) {
-				iloc = reg[PC_REG];
+				iloc = context->reg[PC_REG];
 				if (traceflag) writeInstruction(iloc);
-				stepResult = stepTM();
+				stepResult = tmStep(context);
 				stepcnt--;
 			}
 		}
-		printf("%s\n", stepResultTab[stepResult]);
+		printf("%s\n", tmResultTab[stepResult]);
+		if (stepResult == srBREAK) writeInstruction(iloc = context->reg[PC_REG]);
+		if (stepResult == srWATCH) {
+			writeInstruction(iloc = context->reg[PC_REG] - 1);
+			printf("%5d: %5d\n", context->watchHit, context->dMem[context->watchHit]);
+		}
 	}
 	return TRUE;
 } /* doCommand */
@@ -573,14 +544,143 @@ int doCommand(void) {
 /* E X E C U T I O N   B E G I N S   H E R E */
 /********************************************/
 
-int main(int argc, char* argv[]) {
-	char pgmName[1024]; // Increased buffer size
+void usage(char* progName) {
+	printf("usage: %s [-b] [-i <inputfile>] [-v <v1,v2,...>] [-l <limit>] [-t <seconds>] "
+	       "[-o <outfile>] [-n] [-e <engine>] [-M <words>] [-m <words>] [-p <profile>] "
+	       "[-c <costfile>] [-d <memprofile> [-k <sets>,<ways>,<words>]] [-T <tracefile> [-r <n>]] "
+	       "[-R <log> [-K <steps>]] [-P <log>] [-C <cfile>] <filename>\n",
+	       progName);
+	printf("   -b   batch mode: run to HALT without prompts, exit status reports the result\n");
+	printf("   -i   read IN values from a file (implies -b)\n");
+	printf("   -v   take IN values from the command line (implies -b)\n");
+	printf("   -l   stop after executing at most <limit> instructions\n");
+	printf("   -t   stop each run after <seconds> of wall-clock time\n");
+	printf("   -o   write OUT values to a file instead of stdout (implies -b)\n");
+	printf("   -n   write OUT values alone, one per line, and no HALT line\n");
+	printf("   -e   execution engine for 'go' and batch runs: step (default), threaded or jit\n");
+	printf("   -M   instruction memory size in words (default %d)\n", IADDR_SIZE);
+	printf("   -m   data memory size in words (default %d), allocated as it is touched\n",
+	       DADDR_SIZE);
+	printf("   -p   count every instruction executed (with the step engine) and write a profile\n");
+	printf("        by function, basic block, loop, conditional jump and call site when tm ends\n");
+	printf("   -c   estimate cycles (with the step engine) from the per-opcode and per-event\n");
+	printf("        costs of a cost model file, reported with the instruction counts\n");
+	printf("   -d   count the reads and writes of every data memory address and simulate a\n");
+	printf("        cache (with the step engine); write hit rates by function and array and the\n");
+	printf("        accesses of every address when tm ends\n");
+	printf("   -k   cache geometry for -d: sets, ways and words per line (default %d,%d,%d)\n",
+	       cacheSets, cacheWays, cacheLine);
+	printf("   -T   record every instruction executed (with the step engine) in a binary trace\n");
+	printf("        file, to be printed by tmtrace\n");
+	printf("   -r   keep only the last <n> instructions in memory and write them when tm ends\n");
+	printf("   -R   record the IN values and periodic checkpoints of the run in a replay log\n");
+	printf("        (implies -b)\n");
+	printf("   -K   instructions between the checkpoints of -R (default 1048576)\n");
+	printf("   -P   replay a log written by -R: IN values come from it, and the debugger's\n");
+	printf("        j(ump command goes to any instruction count of the recorded run\n");
+	printf("   -C   translate the program to a standalone C file instead of running it\n");
+	printf("   <filename> is TM assembly (.tm, the default extension) or a binary .tmo object\n");
+	exit(1);
+} /* usage */
 
-	if (argc != 2) {
-		printf("usage: %s <filename>\n", argv[0]);
-		exit(1);
+int main(int argc, char* argv[]) {
+	char*       cFileName = NULL;
+	FILE*       cFile;
+	const char* bad;
+	int         opt;
+
+	outFile = stdout;
+	while ((opt = getopt(argc, argv, "bi:v:l:t:o:ne:M:m:p:c:d:k:T:r:R:K:P:C:")) != -1) {
+		switch (opt) {
+			case 'b':
+				batchflag = TRUE;
+				break;
+			case 'i':
+				batchflag = TRUE;
+				if (!readInputFile(optarg)) exit(1);
+				break;
+			case 'v':
+				batchflag = TRUE;
+				if ((bad = tmAddInputs(&inputs, optarg)) != NULL) {
+					fprintf(stderr, "Illegal input value near '%.10s'\n", bad);
+					exit(1);
+				}
+				break;
+			case 'l':
+				stepLimit = atol(optarg);
+				break;
+			case 't':
+				timeLimit = (long) (atof(optarg) * 1000);
+				if (timeLimit <= 0) usage(argv[0]);
+				break;
+			case 'o':
+				batchflag = TRUE;
+				outFile   = fopen(optarg, "w");
+				if (outFile == NULL) {
+					fprintf(stderr, "cannot open output file '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'n':
+				outputs.raw = TRUE;
+				break;
+			case 'e':
+				for (engine = engSTEP; engine <= engJIT; engine++)
+					if (strcmp(tmEngineTab[engine], optarg) == 0) break;
+				if (engine > engJIT) usage(argv[0]);
+				break;
+			case 'M':
+				codeSize = atoi(optarg);
+				if (codeSize <= 0) usage(argv[0]);
+				break;
+			case 'm':
+				dataSize = atoi(optarg);
+				if (dataSize <= 0) usage(argv[0]);
+				break;
+			case 'p':
+				profileName = optarg;
+				break;
+			case 'c':
+				if (!readCostModel(optarg)) exit(1);
+				break;
+			case 'd':
+				memProfileName = optarg;
+				break;
+			case 'k':
+				if ((sscanf(optarg, "%d,%d,%d", &cacheSets, &cacheWays, &cacheLine) != 3) ||
+				    (cacheSets <= 0) || (cacheWays <= 0) || (cacheLine <= 0))
+					usage(argv[0]);
+				break;
+			case 'T':
+				traceName = optarg;
+				break;
+			case 'r':
+				traceLast = atoi(optarg);
+				if (traceLast <= 0) usage(argv[0]);
+				break;
+			case 'R':
+				batchflag  = TRUE;
+				recordName = optarg;
+				break;
+			case 'K':
+				checkpointInterval = atol(optarg);
+				if (checkpointInterval <= 0) usage(argv[0]);
+				break;
+			case 'P':
+				replayName = optarg;
+				break;
+			case 'C':
+				cFileName = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
 	}
-	strncpy(pgmName, argv[1], sizeof(pgmName) - 1);
+	if ((optind != argc - 1) || ((traceLast > 0) && (traceName == NULL)) ||
+	    ((recordName != NULL) && (replayName != NULL)) ||
+	    ((replayName != NULL) && (inputs.count > 0)))
+		usage(argv[0]);
+	strncpy(pgmName, argv[optind], sizeof(pgmName) - 1);
 	pgmName[sizeof(pgmName) - 1] = '\0'; // Ensure null termination
 
 	if (strchr(pgmName, '.') == NULL) {
@@ -591,20 +691,69 @@ int main(int argc, char* argv[]) {
 			exit(1);
 		}
 	}
-	pgm = fopen(pgmName, "r");
-	if (pgm == NULL) {
-		printf("file '%s' not found\n", pgmName);
+	program = tmProgramNew(codeSize);
+	if ((program == NULL) || ((context = tmContextNew(program, dataSize)) == NULL)) {
+		fprintf(stderr, "out of memory\n");
 		exit(1);
 	}
-
-	/* read the program */
-	if (!readInstructions()) exit(1);
+	/* read the program, either TM assembly or a .tmo object file */
+	if (!tmLoadFile(program, pgmName)) {
+		printf("%s\n", tmError(program));
+		exit(1);
+	}
+	tmReset(context);
+	/* translate to C instead of running */
+	if (cFileName != NULL) {
+		cFile = fopen(cFileName, "w");
+		if (cFile == NULL) {
+			fprintf(stderr, "cannot open output file '%s'\n", cFileName);
+			exit(1);
+		}
+		opt = tmWriteC(program, cFile, pgmName, dataSize);
+		return ((fclose(cFile) == 0) && opt) ? 0 : 1;
+	}
+	if ((engine == engJIT) && !tmTranslate(program)) {
+		fprintf(stderr, "JIT not available, using the threaded engine\n");
+		engine = engTHREADED;
+	}
+	context->engine    = engine;
+	context->timeLimit = timeLimit;
+	context->input     = batchflag ? tmNextInput : promptInput;
+	context->user      = &inputs;
+	context->output    = writeOutput;
+	context->halt      = writeHalt;
+	if (((profileName != NULL) || (cost != NULL)) &&
+	    ((context->profile = tmProfileNew(program)) == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	if ((memProfileName != NULL) &&
+	    ((context->memProfile = tmMemProfileNew(program, dataSize, cacheSets, cacheWays,
+	                                            cacheLine)) == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	if ((traceName != NULL) && !openTrace()) exit(1);
+	if (((recordName != NULL) || (replayName != NULL)) && !openLog()) exit(1);
+	/* batch mode: run to completion, no read-eval-print */
+	if (batchflag) {
+		/* a replay stops where the recorded run did */
+		if ((replay != NULL) && (stepLimit == 0)) stepLimit = tmReplaySteps(replay);
+		opt = runBatch();
+		if (!writeTrace() || !writeMemProfile()) opt = 1;
+		return writeProfile() ? opt : 1;
+	}
 	/* switch input file to terminal */
 	/* reset( input ); */
 	/* read-eval-print */
 	printf("TM  simulation (enter h for help)...\n");
+	if ((replay != NULL) && (tmReplaySteps(replay) >= 0))
+		printf("Replaying a run of %ld instructions\n", tmReplaySteps(replay));
+	else if (replay != NULL)
+		printf("Replaying a run whose log was cut short\n");
 	do done = !doCommand();
 	while (!done);
 	printf("Simulation done.\n");
-	return 0;
+	opt = writeTrace() && writeMemProfile();
+	return (writeProfile() && opt) ? 0 : 1;
 }
\ No newline at end of file
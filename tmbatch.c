@@ -0,0 +1,348 @@
+/****************************************************/
+/* File: tmbatch.c                                  */
+/* Runs many TM program/input jobs on a pool of     */
+/* worker threads                                   */
+/****************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtm/tm.h"
+
+/******* const *******/
+#define LINESIZE 1024
+#define MAX_THREADS 256
+
+/******* type  *******/
+
+typedef struct {
+	char*      fileName;
+	TMProgram* program;
+} PROGRAM;
+
+typedef struct {
+	int        program;   /* index into programTab */
+	char*      inputName; /* NULL: no input */
+	TMInputs   inputs;
+	TMOutputs  outputs; /* OUT and HALT text, as tm prints it */
+	STEPRESULT result;
+	long       steps;
+	long       classCount[3]; /* steps per opcode class */
+} JOB;
+
+/******** vars ********/
+long stepLimit = 0; /* per job, 0 means no limit */
+long timeLimit = 0; /* per job in milliseconds, 0 means no limit */
+int  engine    = engSTEP;
+int  quietflag = FALSE;
+int  rawflag   = FALSE; /* OUT values only, without HALT lines */
+int  codeSize  = 0; /* instruction memory words, 0 means IADDR_SIZE */
+int  dataSize  = 0; /* data memory words of every context, 0 means DADDR_SIZE */
+int  laneCount = 1; /* jobs of one program a worker runs in lockstep */
+
+PROGRAM* programTab = NULL;
+int      programCount = 0;
+
+JOB* jobTab   = NULL;
+int  jobCount = 0;
+
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+int             nextJob = 0; /* next job to be taken by a worker */
+
+/********************************************/
+int jobInput(void* user, int* value) {
+	return tmNextInput(&((JOB*) user)->inputs, value);
+} /* jobInput */
+
+/********************************************/
+void jobOutput(void* user, int value) {
+	if (!tmAppendOutput(&((JOB*) user)->outputs, value)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+} /* jobOutput */
+
+/********************************************/
+void jobHalt(void* user, int r, int s, int t) {
+	if (!tmAppendHalt(&((JOB*) user)->outputs, r, s, t)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+} /* jobHalt */
+
+/********************************************/
+/* quiet runs discard OUT values */
+void noOutput(void* user, int value) {
+} /* noOutput */
+
+/********************************************/
+/* the callbacks and limits of a job, in the context that runs it */
+void setJob(TMContext* context, JOB* job) {
+	context->program   = programTab[job->program].program;
+	context->engine    = engine;
+	context->timeLimit = timeLimit;
+	context->input     = jobInput;
+	context->output    = quietflag ? noOutput : jobOutput;
+	context->halt      = quietflag ? NULL : jobHalt;
+	context->user      = job;
+	job->outputs.raw   = rawflag;
+} /* setJob */
+
+/********************************************/
+/* worker thread with -L: take up to laneCount consecutive jobs of one program at a time and run
+ * them in lockstep, reusing the lanes while the program and the number of jobs stay the same
+ */
+void* laneWorker(void* arg) {
+	TMLanes*    lanes   = NULL;
+	STEPRESULT* results = malloc(laneCount * sizeof(STEPRESULT));
+	JOB*        job;
+	int         first, count = 0, program = -1, n, l;
+	if (results == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (;;) {
+		pthread_mutex_lock(&jobLock);
+		first = nextJob;
+		for (n = 0; (n < laneCount) && (first + n < jobCount) &&
+		            (jobTab[first + n].program == jobTab[first].program);
+		     n++)
+			;
+		nextJob += n;
+		pthread_mutex_unlock(&jobLock);
+		if (n == 0) break;
+		if ((lanes == NULL) || (program != jobTab[first].program) || (count != n)) {
+			tmLanesFree(lanes);
+			program = jobTab[first].program;
+			count   = n;
+			lanes   = tmLanesNew(programTab[program].program, count, dataSize);
+			if (lanes == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		for (l = 0; l < count; l++) setJob(tmLane(lanes, l), &jobTab[first + l]);
+		tmLanesRun(lanes, stepLimit, results);
+		for (l = 0; l < count; l++) {
+			job         = &jobTab[first + l];
+			job->result = results[l];
+			job->steps  = tmLane(lanes, l)->steps;
+			memcpy(job->classCount, tmLane(lanes, l)->classCount, sizeof(job->classCount));
+		}
+	}
+	tmLanesFree(lanes);
+	free(results);
+	return NULL;
+} /* laneWorker */
+
+/********************************************/
+/* worker thread: take jobs in manifest order until none is left, reusing one context */
+void* worker(void* arg) {
+	TMContext* context = tmContextNew(programTab[0].program, dataSize);
+	JOB*       job;
+	int        n;
+	if (context == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (;;) {
+		pthread_mutex_lock(&jobLock);
+		n = nextJob++;
+		pthread_mutex_unlock(&jobLock);
+		if (n >= jobCount) break;
+		job = &jobTab[n];
+		setJob(context, job);
+		tmReset(context);
+		job->result = tmRun(context, stepLimit);
+		job->steps  = context->steps;
+		memcpy(job->classCount, context->classCount, sizeof(job->classCount));
+	}
+	tmContextFree(context);
+	return NULL;
+} /* worker */
+
+/********************************************/
+int findProgram(char* fileName) {
+	int i;
+	for (i = 0; i < programCount; i++)
+		if (strcmp(programTab[i].fileName, fileName) == 0) return i;
+	programTab = realloc(programTab, (programCount + 1) * sizeof(PROGRAM));
+	if (programTab == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	programTab[programCount].fileName = strdup(fileName);
+	programTab[programCount].program  = tmProgramNew(codeSize);
+	if ((programTab[programCount].fileName == NULL) || (programTab[programCount].program == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	if (!tmLoadFile(programTab[programCount].program, fileName)) {
+		fprintf(stderr, "%s: %s\n", fileName, tmError(programTab[programCount].program));
+		return -1;
+	}
+	if ((engine == engJIT) && !tmTranslate(programTab[programCount].program))
+		fprintf(stderr, "%s: JIT not available, using the threaded engine\n", fileName);
+	return programCount++;
+} /* findProgram */
+
+/********************************************/
+/* one job per line: <program> [<input file>]; blank lines and '#' comments are ignored */
+int readManifest(char* fileName) {
+	FILE* f;
+	FILE* in;
+	char  line[LINESIZE];
+	char  programName[LINESIZE];
+	char  inputName[LINESIZE];
+	int   lineNo = 0, fields;
+	JOB*  job;
+	f = fopen(fileName, "r");
+	if (f == NULL) {
+		fprintf(stderr, "manifest '%s' not found\n", fileName);
+		return FALSE;
+	}
+	while (fgets(line, LINESIZE, f) != NULL) {
+		lineNo++;
+		fields = sscanf(line, "%s %s", programName, inputName);
+		if ((fields < 1) || (programName[0] == '#')) continue;
+		jobTab = realloc(jobTab, (jobCount + 1) * sizeof(JOB));
+		if (jobTab == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		job = &jobTab[jobCount];
+		memset(job, 0, sizeof(JOB));
+		job->program = findProgram(programName);
+		if (job->program < 0) {
+			fclose(f);
+			return FALSE;
+		}
+		if (fields == 2) {
+			job->inputName = strdup(inputName);
+			if (job->inputName == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			in = fopen(inputName, "r");
+			if (in == NULL) {
+				fprintf(stderr, "%s:%d: input file '%s' not found\n", fileName, lineNo, inputName);
+				fclose(f);
+				return FALSE;
+			}
+			if (!tmReadInputs(&job->inputs, in)) {
+				fprintf(stderr, "%s:%d: illegal input value in '%s'\n", fileName, lineNo,
+				        inputName);
+				fclose(in);
+				fclose(f);
+				return FALSE;
+			}
+			fclose(in);
+		}
+		jobCount++;
+	}
+	fclose(f);
+	return TRUE;
+} /* readManifest */
+
+/********************************************/
+void usage(char* progName) {
+	printf("usage: %s [-j <threads>] [-e <engine>] [-L <lanes>] [-l <limit>] [-t <seconds>] "
+	       "[-M <words>] [-m <words>] [-q | -n] <manifest>\n",
+	       progName);
+	printf("   -j   number of worker threads (default: one per online processor)\n");
+	printf("   -e   execution engine: step (default), threaded or jit\n");
+	printf("   -L   run up to <lanes> consecutive jobs of the same program in lockstep, one\n");
+	printf("        instruction for all of them at a time, instead of using an engine\n");
+	printf("   -l   stop each job after executing at most <limit> instructions\n");
+	printf("   -t   stop each job after <seconds> of wall-clock time\n");
+	printf("   -M   instruction memory size in words (default %d)\n", IADDR_SIZE);
+	printf("   -m   data memory size in words (default %d), allocated as it is touched\n",
+	       DADDR_SIZE);
+	printf("   -q   discard OUT values, print only the result of each job\n");
+	printf("   -n   print OUT values alone, one per line, and no HALT lines\n");
+	printf("   the manifest lists one job per line: <program> [<input file>]\n");
+	exit(1);
+} /* usage */
+
+int main(int argc, char* argv[]) {
+	pthread_t threads[MAX_THREADS];
+	long      resultCount[srWATCH + 1] = {0};
+	int       threadCount                = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int       status                     = 0;
+	int       opt, i;
+	JOB*      job;
+
+	while ((opt = getopt(argc, argv, "j:e:L:l:t:M:m:qn")) != -1) {
+		switch (opt) {
+			case 'j':
+				threadCount = atoi(optarg);
+				break;
+			case 'e':
+				for (engine = engSTEP; engine <= engJIT; engine++)
+					if (strcmp(tmEngineTab[engine], optarg) == 0) break;
+				if (engine > engJIT) usage(argv[0]);
+				break;
+			case 'L':
+				laneCount = atoi(optarg);
+				if (laneCount <= 0) usage(argv[0]);
+				break;
+			case 'l':
+				stepLimit = atol(optarg);
+				break;
+			case 't':
+				timeLimit = (long) (atof(optarg) * 1000);
+				if (timeLimit <= 0) usage(argv[0]);
+				break;
+			case 'M':
+				codeSize = atoi(optarg);
+				if (codeSize <= 0) usage(argv[0]);
+				break;
+			case 'm':
+				dataSize = atoi(optarg);
+				if (dataSize <= 0) usage(argv[0]);
+				break;
+			case 'q':
+				quietflag = TRUE;
+				break;
+			case 'n':
+				rawflag = TRUE;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1) usage(argv[0]);
+	if (!readManifest(argv[optind])) return 1;
+	if (jobCount == 0) return 0;
+	if (threadCount < 1) threadCount = 1;
+	if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+	if (threadCount > jobCount) threadCount = jobCount;
+
+	for (i = 0; i < threadCount; i++)
+		if (pthread_create(&threads[i], NULL, (laneCount > 1) ? laneWorker : worker, NULL) != 0) {
+			fprintf(stderr, "cannot create worker thread\n");
+			return 1;
+		}
+	for (i = 0; i < threadCount; i++) pthread_join(threads[i], NULL);
+
+	/* report in manifest order; the exit status is that of the first job that did not halt */
+	for (i = 0; i < jobCount; i++) {
+		job = &jobTab[i];
+		printf("* %s %s: %s after %ld instructions (RR %ld, RM %ld, RA %ld)\n",
+		       programTab[job->program].fileName, job->inputName ? job->inputName : "-",
+		       tmResultTab[job->result], job->steps, job->classCount[opclRR],
+		       job->classCount[opclRM], job->classCount[opclRA]);
+		tmWriteOutputs(&job->outputs, stdout);
+		tmFreeOutputs(&job->outputs);
+		resultCount[job->result]++;
+		if ((status == 0) && (job->result != srHALT)) status = tmExitTab[job->result];
+	}
+	fprintf(stderr, "%d jobs, %d threads:", jobCount, threadCount);
+	for (i = srHALT; i <= srWATCH; i++)
+		if (resultCount[i] > 0) fprintf(stderr, " %ld %s", resultCount[i], tmResultTab[i]);
+	fprintf(stderr, "\n");
+	return status;
+} /* main */
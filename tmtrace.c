@@ -0,0 +1,124 @@
+/****************************************************/
+/* File: tmtrace.c                                  */
+/* Prints a binary trace written by tm -T in the    */
+/* format of the tm debugger's instruction trace    */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtm/tm.h"
+#include "tmtrace.h"
+
+/******* const *******/
+#define RECORDBUF_SIZE 4096
+
+/******** vars ********/
+int  valueflag = FALSE;
+long lastCount = 0; /* print only the last records, 0 means all */
+int  codeSize  = 0; /* instruction memory words, 0 means IADDR_SIZE */
+
+TMProgram* program;
+
+/********************************************/
+/* one record, as the debugger traces the instruction, then what it did with -v */
+int writeRecord(const TmtRecord* record, long n) {
+	const INSTRUCTION* in;
+	if ((record->pc < 0) || (record->pc >= tmCodeSize(program)) ||
+	    (tmInstruction(program, record->pc)->iop != record->op)) {
+		fprintf(stderr, "record %ld: %s at %d is not in the program\n", n,
+		        ((record->op >= 0) && (record->op <= opRALim)) ? tmOpCodeTab[record->op] : "?",
+		        record->pc);
+		return FALSE;
+	}
+	in = tmInstruction(program, record->pc);
+	printf("%5d: ", record->pc);
+	tmWriteInstruction(program, record->pc, stdout);
+	if (valueflag) {
+		printf("    r%d = %d", in->iarg1, record->value);
+		if (record->address >= 0) printf("  [%d]", record->address);
+	}
+	printf("\n");
+	return TRUE;
+} /* writeRecord */
+
+/********************************************/
+int decodeTrace(char* fileName) {
+	FILE*     f;
+	TmtHeader header;
+	TmtRecord buf[RECORDBUF_SIZE];
+	long      count, n, first;
+	size_t    got, i;
+	f = fopen(fileName, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "trace file '%s' not found\n", fileName);
+		return FALSE;
+	}
+	if ((fread(&header, sizeof(header), 1, f) != 1) || (header.magic != TMT_MAGIC) ||
+	    (header.version != TMT_VERSION)) {
+		fprintf(stderr, "'%s' is not a TM trace file\n", fileName);
+		fclose(f);
+		return FALSE;
+	}
+	/* records are fixed size, so the last ones can be found by seeking */
+	fseek(f, 0, SEEK_END);
+	count = (ftell(f) - (long) sizeof(header)) / (long) sizeof(TmtRecord);
+	first = ((lastCount > 0) && (lastCount < count)) ? count - lastCount : 0;
+	fseek(f, (long) sizeof(header) + first * (long) sizeof(TmtRecord), SEEK_SET);
+	if (header.skipped + first > 0)
+		printf("(%ld earlier instructions not shown)\n", (long) header.skipped + first);
+	for (n = first; (got = fread(buf, sizeof(TmtRecord), RECORDBUF_SIZE, f)) > 0; n += got)
+		for (i = 0; i < got; i++)
+			if (!writeRecord(&buf[i], header.skipped + n + i)) {
+				fclose(f);
+				return FALSE;
+			}
+	fclose(f);
+	return TRUE;
+} /* decodeTrace */
+
+/********************************************/
+void usage(char* progName) {
+	printf("usage: %s [-v] [-n <count>] [-M <words>] <program> <tracefile>\n", progName);
+	printf("   -v   also print register r after each instruction and the address of LD and ST\n");
+	printf("   -n   print only the last <count> instructions\n");
+	printf("   -M   instruction memory size in words the program ran with (default %d)\n",
+	       IADDR_SIZE);
+	printf("   <program> is the .tm or .tmo file tm -T ran\n");
+	exit(1);
+} /* usage */
+
+int main(int argc, char* argv[]) {
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vn:M:")) != -1) {
+		switch (opt) {
+			case 'v':
+				valueflag = TRUE;
+				break;
+			case 'n':
+				lastCount = atol(optarg);
+				if (lastCount <= 0) usage(argv[0]);
+				break;
+			case 'M':
+				codeSize = atoi(optarg);
+				if (codeSize <= 0) usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc - 2) usage(argv[0]);
+	program = tmProgramNew(codeSize);
+	if (program == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	if (!tmLoadFile(program, argv[optind])) {
+		fprintf(stderr, "%s: %s\n", argv[optind], tmError(program));
+		return 1;
+	}
+	return decodeTrace(argv[optind + 1]) ? 0 : 1;
+} /* main */